@@ -0,0 +1,946 @@
+#include "codecs.hpp"
+
+#include "memory.hpp"
+#include "prefetcher.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <variant>
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace std;
+using namespace cimg_library;
+using Img = CImg<gmic_pixel_type>;
+using ImgList = CImgList<gmic_pixel_type>;
+
+static constexpr pair<string_view, image_format> FORMAT_NAMES[] = {
+    {"png", image_format::PNG},   {"jpeg", image_format::JPEG},
+    {"jpg", image_format::JPEG},  {"tiff", image_format::TIFF},
+    {"tif", image_format::TIFF},  {"bmp", image_format::BMP},
+    {"pnm", image_format::PNM},   {"pbm", image_format::PNM},
+    {"pgm", image_format::PNM},   {"ppm", image_format::PNM},
+    {"pfm", image_format::PFM},   {"cimg", image_format::CIMG},
+    {"cimgz", image_format::CIMG}};
+
+image_format parse_format(string_view name)
+{
+    if (name.starts_with('.'))
+        name.remove_prefix(1);
+    string lower(name);
+    ranges::transform(lower, lower.begin(), [](const unsigned char c) {
+        return static_cast<char>(tolower(c));
+    });
+    for (const auto &[fmt_name, fmt] : FORMAT_NAMES)
+        if (fmt_name == lower)
+            return fmt;
+    throw nb::value_error(("Unsupported image format: " + lower).c_str());
+}
+
+optional<image_format> sniff_format(const uint8_t *data, const size_t size)
+{
+    const auto starts_with = [&](const string_view magic) {
+        return size >= magic.size() &&
+               memcmp(data, magic.data(), magic.size()) == 0;
+    };
+    if (starts_with("\x89PNG\r\n\x1a\n"))
+        return image_format::PNG;
+    if (starts_with("\xff\xd8\xff"))
+        return image_format::JPEG;
+    if (starts_with({"II*\0", 4}) || starts_with({"MM\0*", 4}))
+        return image_format::TIFF;
+    if (starts_with("BM"))
+        return image_format::BMP;
+    if (size >= 2 && data[0] == 'P') {
+        if (data[1] >= '1' && data[1] <= '6')
+            return image_format::PNM;
+        if (data[1] == 'f' || data[1] == 'F')
+            return image_format::PFM;
+    }
+    // .cimg(z) headers start with the number of images, e.g. "1 float"
+    size_t i = 0;
+    while (i < size && isdigit(data[i]))
+        ++i;
+    if (i > 0 && i < size && data[i] == ' ')
+        return image_format::CIMG;
+    return {};
+}
+
+/// Resolves the format of some data, from its name if given
+static image_format data_format(const uint8_t *data, const size_t size,
+                                const optional<string> &format)
+{
+    if (format)
+        return parse_format(*format);
+    if (const auto fmt = sniff_format(data, size))
+        return *fmt;
+    throw nb::value_error(
+        "Couldn't guess the image format from the data, please specify it");
+}
+
+/// Read-only stream over a memory buffer
+static unique_ptr<FILE, int (*)(FILE *)> open_memory(const uint8_t *data,
+                                                     const size_t size)
+{
+#ifdef _WIN32
+    // No fmemopen(): fall back to an anonymous temporary file
+    FILE *file = tmpfile();
+    if (file &&
+        (fwrite(data, 1, size, file) != size || fseek(file, 0, SEEK_SET))) {
+        fclose(file);
+        file = nullptr;
+    }
+#else
+    FILE *file = fmemopen(const_cast<uint8_t *>(data), size, "rb");
+#endif
+    if (!file)
+        throw runtime_error("Couldn't open a stream over the image data");
+    return {file, fclose};
+}
+
+#ifndef cimg_use_tiff
+/// Temporary file, for TIFF data, which CImg then reads and writes by name
+class temporary_file {
+    string path;
+
+   public:
+    explicit temporary_file(const char *ext)
+        : path(string(cimg::temporary_path()) + cimg_file_separator +
+               "gmicpy_" + cimg::filenamerand() + '.' + ext)
+    {
+    }
+    temporary_file(const uint8_t *data, const size_t size, const char *ext)
+        : temporary_file(ext)
+    {
+        ofstream out(path, ios::binary);
+        out.write(reinterpret_cast<const char *>(data),
+                  static_cast<streamsize>(size));
+        if (!out)
+            throw runtime_error("Couldn't write temporary file " + path);
+    }
+    temporary_file(const temporary_file &) = delete;
+    temporary_file &operator=(const temporary_file &) = delete;
+    ~temporary_file() { std::remove(path.c_str()); }
+
+    [[nodiscard]] const char *c_str() const { return path.c_str(); }
+
+    /// Appends the file's contents to a stream
+    void copy_to(FILE *out) const
+    {
+        ifstream in(path, ios::binary);
+        char buf[1 << 16];
+        while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+            const auto n = static_cast<size_t>(in.gcount());
+            if (fwrite(buf, 1, n, out) != n)
+                throw runtime_error("Couldn't write encoded image data");
+        }
+    }
+};
+#endif
+
+/// Growable in-memory stream receiving encoded data
+class memory_sink {
+    FILE *file = nullptr;
+#ifdef _WIN32
+    // No open_memstream(): data goes through an anonymous temporary file
+    vector<char> buf;
+#else
+    char *buf = nullptr;
+    size_t size = 0;
+#endif
+
+   public:
+    memory_sink()
+    {
+#ifdef _WIN32
+        file = tmpfile();
+#else
+        file = open_memstream(&buf, &size);
+#endif
+        if (!file)
+            throw runtime_error("Couldn't open an in-memory stream");
+    }
+    memory_sink(const memory_sink &) = delete;
+    memory_sink &operator=(const memory_sink &) = delete;
+    ~memory_sink()
+    {
+        fclose(file);
+#ifndef _WIN32
+        free(buf);
+#endif
+    }
+
+    [[nodiscard]] FILE *stream() const { return file; }
+
+    /// Returns everything written so far, valid until the next write
+    [[nodiscard]] string_view data()
+    {
+#ifdef _WIN32
+        buf.resize(static_cast<size_t>(ftell(file)));
+        rewind(file);
+        if (fread(buf.data(), 1, buf.size(), file) != buf.size())
+            throw runtime_error("Couldn't read encoded image data");
+        return {buf.data(), buf.size()};
+#else
+        fflush(file);
+        return {buf, size};
+#endif
+    }
+};
+
+#ifdef cimg_use_tiff
+/// Seekable in-memory file, through libtiff's client I/O
+class tiff_memory {
+    /// Data read from, or nullptr when writing to written
+    const uint8_t *source = nullptr;
+    size_t source_size = 0;
+    string written;
+    size_t pos = 0;
+
+    [[nodiscard]] const char *bytes() const
+    {
+        return source ? reinterpret_cast<const char *>(source)
+                      : written.data();
+    }
+    [[nodiscard]] size_t length() const
+    {
+        return source ? source_size : written.size();
+    }
+
+    static tiff_memory &self(const thandle_t handle)
+    {
+        return *static_cast<tiff_memory *>(handle);
+    }
+    static tmsize_t read(const thandle_t handle, void *const buf,
+                         const tmsize_t n)
+    {
+        auto &mem = self(handle);
+        const size_t left = mem.length() - min(mem.pos, mem.length());
+        const size_t count = min(static_cast<size_t>(n), left);
+        if (count)
+            memcpy(buf, mem.bytes() + mem.pos, count);
+        mem.pos += count;
+        return static_cast<tmsize_t>(count);
+    }
+    static tmsize_t write(const thandle_t handle, void *const buf,
+                          const tmsize_t n)
+    {
+        auto &mem = self(handle);
+        if (mem.source)
+            return -1;
+        const auto count = static_cast<size_t>(n);
+        if (mem.written.size() < mem.pos + count)
+            mem.written.resize(mem.pos + count);
+        memcpy(mem.written.data() + mem.pos, buf, count);
+        mem.pos += count;
+        return n;
+    }
+    static toff_t seek(const thandle_t handle, const toff_t offset,
+                       const int whence)
+    {
+        auto &mem = self(handle);
+        // Negative offsets wrap around, as toff_t is unsigned
+        const toff_t base = whence == SEEK_CUR   ? mem.pos
+                            : whence == SEEK_END ? mem.length()
+                                                 : 0;
+        mem.pos = static_cast<size_t>(base + offset);
+        return mem.pos;
+    }
+    static int close(thandle_t) { return 0; }
+    static toff_t file_size(const thandle_t handle)
+    {
+        return self(handle).length();
+    }
+    static int map(thandle_t, void **, toff_t *) { return 0; }
+    static void unmap(thandle_t, void *, toff_t) {}
+
+   public:
+    /// Empty file, to write to
+    tiff_memory() = default;
+    /// Read-only file over some data
+    tiff_memory(const uint8_t *data, const size_t size)
+        : source(data), source_size(size)
+    {
+    }
+
+    [[nodiscard]] unique_ptr<TIFF, void (*)(TIFF *)> open(const char *mode)
+    {
+        TIFF *tif = TIFFClientOpen("gmicpy", mode, this, read, write, seek,
+                                   close, file_size, map, unmap);
+        if (!tif)
+            throw runtime_error("Couldn't open the TIFF data");
+        return {tif, TIFFClose};
+    }
+
+    /// Everything written, once the TIFF is closed
+    [[nodiscard]] string_view contents() const { return written; }
+};
+
+/// Decodes every directory of some TIFF data as an image
+static void load_tiff(ImgList &frames, const uint8_t *data, const size_t size)
+{
+    tiff_memory file(data, size);
+    const auto tif = file.open("r");
+    unsigned int count = 0;
+    do
+        ++count;
+    while (TIFFReadDirectory(tif.get()));
+    frames.assign(count);
+    for (unsigned int i = 0; i < count; ++i)
+        frames[i]._load_tiff(tif.get(), i, nullptr, nullptr, nullptr);
+}
+
+/// Writes each z slice of count images as a TIFF directory
+static void save_tiff(FILE *out, const Img *images, const size_t count,
+                      const unsigned int compression)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i)
+        bytes += images[i].size() * sizeof(gmic_pixel_type);
+    tiff_memory file;
+    {
+        // BigTIFF past 2 GiB, like CImg::save_tiff()
+        const auto tif = file.open(bytes >= size_t{1} << 31 ? "w8" : "w");
+        unsigned int directory = 0;
+        for (size_t i = 0; i < count; ++i)
+            cimg_forZ(images[i], z) images[i]._save_tiff(
+                tif.get(), directory++, z, compression, nullptr, nullptr);
+    }
+    const auto data = file.contents();
+    if (fwrite(data.data(), 1, data.size(), out) != data.size())
+        throw runtime_error("Couldn't write encoded image data");
+}
+#endif
+
+/// Writes the first z slice and up to 3 channels of img as PFM
+static void save_pfm(const Img &img, FILE *out)
+{
+    const unsigned int width = img.width(), height = img.height(),
+                       spectrum = img.spectrum();
+    const unsigned int channels = spectrum == 1 ? 1 : 3;
+    // Negative scales mark little-endian data
+    if (fprintf(out, "P%c\n%u %u\n%s\n", channels == 1 ? 'f' : 'F', width,
+                height, cimg::endianness() ? "1.0" : "-1.0") < 0)
+        throw runtime_error("Couldn't write encoded image data");
+    vector<float> row(static_cast<size_t>(width) * channels);
+    // Rows go from the bottom to the top
+    for (unsigned int y = height; y-- > 0;) {
+        for (unsigned int x = 0; x < width; ++x)
+            for (unsigned int c = 0; c < channels; ++c)
+                row[x * channels + c] =
+                    c < spectrum ? static_cast<float>(img(x, y, 0, c)) : 0.f;
+        if (fwrite(row.data(), sizeof(float), row.size(), out) != row.size())
+            throw runtime_error("Couldn't write encoded image data");
+    }
+}
+
+/// Product of sizes, saturated instead of overflowing
+static size_t saturated_product(const initializer_list<size_t> sizes)
+{
+    size_t product = 1;
+    for (const auto size : sizes) {
+        if (size && product > SIZE_MAX / size)
+            return SIZE_MAX;
+        product *= size;
+    }
+    return product;
+}
+
+/// Sum of sizes, saturated instead of overflowing
+static size_t saturated_sum(const size_t a, const size_t b)
+{
+    return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+}
+
+/// Bytes of a decoded image of the given dimensions
+static size_t decoded_bytes(const size_t width, const size_t height,
+                            const size_t depth, const size_t spectrum)
+{
+    return saturated_product(
+        {width, height, depth, spectrum, sizeof(gmic_pixel_type)});
+}
+
+static size_t read_be(const uint8_t *p, const size_t n)
+{
+    size_t value = 0;
+    for (size_t i = 0; i < n; ++i)
+        value = value << 8 | p[i];
+    return value;
+}
+
+static size_t read_le(const uint8_t *p, const size_t n)
+{
+    size_t value = 0;
+    for (size_t i = n; i-- > 0;)
+        value = value << 8 | p[i];
+    return value;
+}
+
+/// Reader of the numbers and lines of the text headers of PNM, PFM and .cimg
+class text_header {
+    const uint8_t *p, *const end;
+
+   public:
+    text_header(const uint8_t *data, const size_t size)
+        : p(data), end(data + size)
+    {
+    }
+
+    /// Next unsigned number, skipping whitespace and '#' comments if asked
+    optional<size_t> number(const bool comments = false)
+    {
+        while (p < end && (isspace(*p) || (comments && *p == '#'))) {
+            if (*p == '#')
+                while (p < end && *p != '\n')
+                    ++p;
+            else
+                ++p;
+        }
+        if (p == end || !isdigit(*p))
+            return nullopt;
+        size_t value = 0;
+        for (; p < end && isdigit(*p); ++p)
+            value = saturated_sum(saturated_product({value, 10}),
+                                  static_cast<size_t>(*p - '0'));
+        return value;
+    }
+
+    /// Rest of the current line, which is skipped
+    string_view line()
+    {
+        const auto *start = p;
+        while (p < end && *p != '\n')
+            ++p;
+        const string_view rest(reinterpret_cast<const char *>(start),
+                               p - start);
+        if (p < end)
+            ++p;
+        return rest;
+    }
+
+    /// Skips n bytes, returning false past the end of the data
+    bool skip(const size_t n)
+    {
+        if (n > static_cast<size_t>(end - p))
+            return false;
+        p += n;
+        return true;
+    }
+};
+
+static size_t png_bytes(const uint8_t *data, const size_t size)
+{
+    // IHDR is the first chunk: width, height, bit depth and color type
+    if (size < 26 || memcmp(data + 12, "IHDR", 4) != 0)
+        return 0;
+    // Palettes are expanded to RGB (and alpha, which decoding adds)
+    static constexpr size_t CHANNELS[] = {1, 0, 3, 3, 2, 0, 4};
+    const auto color_type = data[25];
+    if (color_type >= std::size(CHANNELS) || !CHANNELS[color_type])
+        return 0;
+    return decoded_bytes(read_be(data + 16, 4), read_be(data + 20, 4), 1,
+                         CHANNELS[color_type]);
+}
+
+static size_t jpeg_bytes(const uint8_t *data, const size_t size)
+{
+    // Markers up to the start of frame, which holds the dimensions
+    size_t pos = 2;
+    while (pos + 4 <= size && data[pos] == 0xff) {
+        const auto marker = data[pos + 1];
+        if (marker == 0xff || marker == 0x01 ||
+            (marker >= 0xd0 && marker <= 0xd8)) {
+            pos += marker == 0xff ? 1 : 2;
+            continue;
+        }
+        if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 &&
+            marker != 0xc8 && marker != 0xcc)
+            return pos + 10 <= size
+                       ? decoded_bytes(read_be(data + pos + 7, 2),
+                                       read_be(data + pos + 5, 2), 1,
+                                       data[pos + 9])
+                       : 0;
+        pos += 2 + read_be(data + pos + 2, 2);
+    }
+    return 0;
+}
+
+static size_t bmp_bytes(const uint8_t *data, const size_t size)
+{
+    if (size < 26)
+        return 0;
+    // OS/2 headers have 16-bit dimensions, others signed 32-bit ones, with
+    // negative heights for top-down rows. Decoded images are RGB.
+    if (read_le(data + 14, 4) == 12)
+        return decoded_bytes(read_le(data + 18, 2), read_le(data + 20, 2), 1,
+                             3);
+    const auto height = static_cast<int32_t>(read_le(data + 22, 4));
+    return decoded_bytes(read_le(data + 18, 4),
+                         height < 0 ? -int64_t{height} : height, 1, 3);
+}
+
+/// PNM (P1 to P6) and PFM (Pf and PF) headers: magic, width, height...
+static size_t netpbm_bytes(const uint8_t *data, const size_t size)
+{
+    if (size < 2 || data[0] != 'P')
+        return 0;
+    const auto kind = data[1];
+    const bool color = kind == '3' || kind == '6' || kind == 'F';
+    if (!color && kind != 'f' && (kind < '1' || kind > '6'))
+        return 0;
+    text_header header(data + 2, size - 2);
+    const bool comments = kind != 'f' && kind != 'F';
+    const auto width = header.number(comments);
+    const auto height = header.number(comments);
+    if (!width || !height)
+        return 0;
+    return decoded_bytes(*width, *height, 1, color ? 3 : 1);
+}
+
+/// Size of the values of a .cimg file, from the name of their type
+static size_t cimg_value_size(const string_view type)
+{
+    static constexpr pair<string_view, size_t> SIZES[] = {
+        {"bool", 1},           {"char", 1},
+        {"int8", 1},           {"uchar", 1},
+        {"unsigned_char", 1},  {"uint8", 1},
+        {"short", 2},          {"int16", 2},
+        {"ushort", 2},         {"unsigned_short", 2},
+        {"uint16", 2},         {"int", 4},
+        {"int32", 4},          {"uint", 4},
+        {"unsigned_int", 4},   {"uint32", 4},
+        {"float", 4},          {"float32", 4},
+        {"int64", 8},          {"uint64", 8},
+        {"unsigned_int64", 8}, {"double", 8},
+        {"float64", 8}};
+    for (const auto &[name, size] : SIZES)
+        if (name == type)
+            return size;
+    return 0;
+}
+
+/**
+ * .cimg(z) headers: the number of images and their value type, then the
+ * dimensions of each image before its data, compressed if they are
+ * followed by #<compressed size>
+ */
+static size_t cimg_bytes(const uint8_t *data, const size_t size)
+{
+    text_header header(data, size);
+    const auto count = header.number();
+    if (!count)
+        return 0;
+    auto type = header.line();
+    type.remove_prefix(min(type.find_first_not_of(' '), type.size()));
+    const size_t value_size = cimg_value_size(type.substr(0, type.find(' ')));
+    if (!value_size)
+        return 0;
+    size_t bytes = 0;
+    for (size_t i = 0; i < *count; ++i) {
+        const auto width = header.number(), height = header.number(),
+                   depth = header.number(), spectrum = header.number();
+        if (!width || !height || !depth || !spectrum)
+            return 0;
+        bytes = saturated_sum(
+            bytes, decoded_bytes(*width, *height, *depth, *spectrum));
+        const auto rest = header.line();
+        if (i + 1 == *count)
+            break;
+        const auto compressed = rest.find('#');
+        const size_t stored =
+            compressed == string_view::npos
+                ? saturated_product(
+                      {*width, *height, *depth, *spectrum, value_size})
+                : text_header(reinterpret_cast<const uint8_t *>(
+                                  rest.data() + compressed + 1),
+                              rest.size() - compressed - 1)
+                      .number()
+                      .value_or(SIZE_MAX);
+        if (!header.skip(stored))
+            return 0;
+    }
+    return bytes;
+}
+
+#ifdef cimg_use_tiff
+/// Every directory of a TIFF file is decoded as an image
+static size_t tiff_bytes(const uint8_t *data, const size_t size)
+{
+    tiff_memory file(data, size);
+    const auto tif = file.open("r");
+    size_t bytes = 0;
+    do {
+        uint32_t width = 0, height = 0;
+        uint16_t samples = 1;
+        TIFFGetField(tif.get(), TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tif.get(), TIFFTAG_IMAGELENGTH, &height);
+        TIFFGetFieldDefaulted(tif.get(), TIFFTAG_SAMPLESPERPIXEL, &samples);
+        bytes = saturated_sum(bytes, decoded_bytes(width, height, 1, samples));
+    } while (TIFFReadDirectory(tif.get()));
+    return bytes;
+}
+#endif
+
+/**
+ * Bytes of the images decoding some data allocates, from the dimensions in
+ * its header, 0 if they aren't known beforehand (unexpected headers, TIFF
+ * data without libtiff)
+ */
+static size_t header_bytes(const uint8_t *data, const size_t size,
+                           const image_format format)
+{
+    switch (format) {
+        case image_format::PNG:
+            return png_bytes(data, size);
+        case image_format::JPEG:
+            return jpeg_bytes(data, size);
+        case image_format::BMP:
+            return bmp_bytes(data, size);
+        case image_format::PNM:
+        case image_format::PFM:
+            return netpbm_bytes(data, size);
+        case image_format::CIMG:
+            return cimg_bytes(data, size);
+        case image_format::TIFF:
+#ifdef cimg_use_tiff
+            return tiff_bytes(data, size);
+#else
+            return 0;
+#endif
+    }
+    return 0;
+}
+
+static void decode(Img &img, const uint8_t *data, const size_t size,
+                   const image_format format)
+{
+    if (format == image_format::TIFF) {
+#ifdef cimg_use_tiff
+        // Like CImg::load_tiff(), stacks the frames along z
+        ImgList frames;
+        load_tiff(frames, data, size);
+        if (frames.size() == 1)
+            frames[0].move_to(img);
+        else
+            frames.get_append('z').move_to(img);
+#else
+        // Without libtiff, CImg reads TIFF files through external tools
+        const temporary_file file(data, size, "tif");
+        img.load_tiff(file.c_str());
+#endif
+        return;
+    }
+    const auto file = open_memory(data, size);
+    switch (format) {
+        case image_format::PNG:
+            img.load_png(file.get());
+            break;
+        case image_format::JPEG:
+            img.load_jpeg(file.get());
+            break;
+        case image_format::BMP:
+            img.load_bmp(file.get());
+            break;
+        case image_format::PNM:
+            img.load_pnm(file.get());
+            break;
+        case image_format::PFM:
+            img.load_pfm(file.get());
+            break;
+        case image_format::CIMG:
+            img.load_cimg(file.get());
+            break;
+        default:
+            break;
+    }
+}
+
+static void decode(ImgList &list, const uint8_t *data, const size_t size,
+                   const image_format format)
+{
+    ImgList frames;
+    if (format == image_format::TIFF) {
+#ifdef cimg_use_tiff
+        load_tiff(frames, data, size);
+#else
+        const temporary_file file(data, size, "tif");
+        frames.load_tiff(file.c_str());
+#endif
+    }
+    else if (format == image_format::CIMG) {
+        frames.load_cimg(open_memory(data, size).get());
+    }
+    else {
+        decode(frames.insert(1).back(), data, size, format);
+    }
+    frames.move_to(list, list.size());
+}
+
+/// Format-specific options of Image.encode() and ImageList.encode()
+struct encode_options {
+    unsigned int quality = 100;
+    unsigned int bytes_per_pixel = 0;
+    unsigned int tiff_compression = 0;
+    bool compressed = false;
+};
+
+static encode_options parse_options(const string &format,
+                                    const image_format fmt,
+                                    const nb::kwargs &kwargs)
+{
+    encode_options opts;
+    opts.compressed = format.ends_with("cimgz");
+    for (const auto &[key, value] : kwargs) {
+        const auto name = nb::cast<string>(key);
+        if (name == "quality" && fmt == image_format::JPEG) {
+            opts.quality = nb::cast<unsigned int>(value);
+            if (opts.quality > 100)
+                throw nb::value_error("JPEG quality must be in [0, 100]");
+        }
+        else if (name == "bytes_per_pixel" &&
+                 (fmt == image_format::PNG || fmt == image_format::PNM)) {
+            opts.bytes_per_pixel = nb::cast<unsigned int>(value);
+        }
+        else if (name == "compression" && fmt == image_format::TIFF) {
+            static constexpr string_view TIFF_COMPRESSIONS[] = {"none", "lzw",
+                                                                "jpeg"};
+            const auto it = ranges::find(TIFF_COMPRESSIONS,
+                                         nb::cast<string_view>(value));
+            if (it == end(TIFF_COMPRESSIONS))
+                throw nb::value_error(
+                    "TIFF compression must be 'none', 'lzw' or 'jpeg'");
+            opts.tiff_compression =
+                static_cast<unsigned int>(it - begin(TIFF_COMPRESSIONS));
+        }
+        else if (name == "compression" && fmt == image_format::CIMG) {
+            opts.compressed = nb::cast<bool>(value);
+        }
+        else {
+            throw nb::type_error(("Unsupported option for " + format +
+                                  " encoding: " + name)
+                                     .c_str());
+        }
+    }
+    return opts;
+}
+
+static void encode(const Img &img, memory_sink &sink,
+                   const image_format format, const encode_options &opts)
+{
+    FILE *out = sink.stream();
+    switch (format) {
+        case image_format::PNG:
+            img.save_png(out, opts.bytes_per_pixel);
+            break;
+        case image_format::JPEG:
+            img.save_jpeg(out, opts.quality);
+            break;
+        case image_format::BMP:
+            img.save_bmp(out);
+            break;
+        case image_format::PNM:
+            img.save_pnm(out, opts.bytes_per_pixel);
+            break;
+        case image_format::CIMG:
+            img.save_cimg(out, opts.compressed);
+            break;
+        case image_format::TIFF: {
+#ifdef cimg_use_tiff
+            save_tiff(out, &img, 1, opts.tiff_compression);
+#else
+            const temporary_file file("tif");
+            img.save_tiff(file.c_str(), opts.tiff_compression);
+            file.copy_to(out);
+#endif
+            break;
+        }
+        case image_format::PFM:
+            save_pfm(img, out);
+            break;
+    }
+}
+
+static void encode(const ImgList &list, memory_sink &sink,
+                   const image_format format, const encode_options &opts)
+{
+    if (format == image_format::CIMG) {
+        list.save_cimg(sink.stream(), opts.compressed);
+    }
+    else if (format == image_format::TIFF) {
+#ifdef cimg_use_tiff
+        save_tiff(sink.stream(), list.data(), list.size(),
+                  opts.tiff_compression);
+#else
+        const temporary_file file("tif");
+        list.save_tiff(file.c_str(), opts.tiff_compression);
+        file.copy_to(sink.stream());
+#endif
+    }
+    else if (list.size() == 1) {
+        encode(list[0], sink, format, opts);
+    }
+    else {
+        throw nb::value_error(
+            "Only the TIFF and .cimg formats can hold several images");
+    }
+}
+
+/// Encodes an image or list with the GIL released, into a bytes object
+template <class I>
+static nb::bytes to_bytes(const I &images, const string &format,
+                          const nb::kwargs &options)
+{
+    const auto fmt = parse_format(format);
+    const auto opts = parse_options(format, fmt, options);
+    memory_sink sink;
+    string_view data;
+    {
+        nb::gil_scoped_release release;
+        encode(images, sink, fmt, opts);
+        data = sink.data();
+    }
+    return {data.data(), data.size()};
+}
+
+nb::bytes image_to_bytes(const Img &img, const string &format,
+                         const nb::kwargs &options)
+{
+    if (img.is_empty())
+        throw nb::value_error("Can't encode an empty image");
+    return to_bytes(img, format, options);
+}
+
+nb::bytes list_to_bytes(const ImgList &list, const string &format,
+                        const nb::kwargs &options)
+{
+    if (list.is_empty())
+        throw nb::value_error("Can't encode an empty list");
+    return to_bytes(list, format, options);
+}
+
+Img image_from_bytes(const byte_array &data, const optional<string> &format)
+{
+    if (data.size() == 0)
+        throw nb::value_error("No image data");
+    const auto fmt = data_format(data.data(), data.size(), format);
+    Img img;
+    auto room = MEMORY.reserve(header_bytes(data.data(), data.size(), fmt));
+    {
+        nb::gil_scoped_release release;
+        decode(img, data.data(), data.size(), fmt);
+    }
+    // Counted as live once returned
+    room.grow(owned_bytes(img));
+    return img;
+}
+
+memory_limit::reservation list_from_bytes(ImgList &list,
+                                          const byte_array &data,
+                                          const optional<string> &format)
+{
+    if (data.size() == 0)
+        throw nb::value_error("No image data");
+    const auto fmt = data_format(data.data(), data.size(), format);
+    nb::gil_scoped_release release;
+    // Only added to the list once room is reserved for them
+    auto room = MEMORY.reserve(header_bytes(data.data(), data.size(), fmt));
+    ImgList decoded;
+    decode(decoded, data.data(), data.size(), fmt);
+    room.grow(owned_bytes(decoded));
+    decoded.move_to(list, list.size());
+    return room;
+}
+
+memory_limit::reservation decode_many(ImgList &list,
+                                      const nb::handle &sources,
+                                      const optional<string> &format,
+                                      const unsigned int threads)
+{
+    // Sources are gathered with the GIL held, and kept alive until the end
+    vector<variant<filesystem::path, byte_array>> inputs;
+    for (const auto &obj : sources) {
+        if (nb::isinstance<nb::str>(obj) || nb::hasattr(obj, "__fspath__"))
+            inputs.emplace_back(nb::cast<filesystem::path>(obj));
+        else
+            inputs.emplace_back(nb::cast<byte_array>(obj));
+    }
+    const auto fmt = format ? optional(parse_format(*format)) : nullopt;
+
+    nb::gil_scoped_release release;
+    // Room for the data whose headers give the size of their images is
+    // reserved before decoding, the rest once decoded
+    size_t expected = 0;
+    for (const auto &input : inputs) {
+        const auto *data = get_if<byte_array>(&input);
+        if (!data)
+            continue;
+        const auto data_fmt =
+            fmt ? fmt : sniff_format(data->data(), data->size());
+        if (data_fmt)
+            expected = saturated_sum(
+                expected, header_bytes(data->data(), data->size(), *data_fmt));
+    }
+    auto room = MEMORY.reserve(expected);
+    const auto lease = THREADS.acquire(threads);
+    ordered_prefetcher<Img> pool(
+        inputs.size(),
+        [&](const size_t i) {
+            Img img;
+            if (const auto *path = get_if<filesystem::path>(&inputs[i])) {
+                img.load(path->string().c_str());
+            }
+            else {
+                const auto &data = get<byte_array>(inputs[i]);
+                if (data.size() == 0)
+                    throw nb::value_error("No image data");
+                decode(img, data.data(), data.size(),
+                       fmt ? *fmt : data_format(data.data(), data.size(), {}));
+            }
+            return img;
+        },
+        inputs.size(), lease.threads());
+    ImgList decoded(static_cast<unsigned int>(inputs.size()));
+    size_t bytes = 0;
+    for (auto &img : decoded) {
+        pool.next()->move_to(img);
+        bytes += owned_bytes(img);
+        room.grow(bytes);
+    }
+    decoded.move_to(list, list.size());
+    return room;
+}
+
+nb::list encode_many(const vector<const Img *> &images, const string &format,
+                     const nb::kwargs &options, const unsigned int threads)
+{
+    const auto fmt = parse_format(format);
+    const auto opts = parse_options(format, fmt, options);
+    for (const auto *img : images)
+        if (img->is_empty())
+            throw nb::value_error("Can't encode an empty image");
+
+    vector<string> encoded(images.size());
+    {
+        nb::gil_scoped_release release;
+        const auto lease = THREADS.acquire(threads);
+        ordered_prefetcher<string> pool(
+            images.size(),
+            [&](const size_t i) {
+                memory_sink sink;
+                encode(*images[i], sink, fmt, opts);
+                return string(sink.data());
+            },
+            images.size(), lease.threads());
+        for (auto &data : encoded)
+            data = std::move(*pool.next());
+    }
+    nb::list out;
+    for (const auto &data : encoded)
+        out.append(nb::bytes(data.data(), data.size()));
+    return out;
+}
+
+}  // namespace gmicpy
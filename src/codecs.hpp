@@ -0,0 +1,78 @@
+#ifndef CODECS_HPP
+#define CODECS_HPP
+#include "gmicpy.hpp"
+#include "memory.hpp"
+
+namespace gmicpy {
+
+/// Read-only contiguous bytes, from any buffer-protocol object
+using byte_array = nanobind::ndarray<const uint8_t, nanobind::ndim<1>,
+                                     nanobind::c_contig,
+                                     nanobind::device::cpu>;
+
+/// Image file formats handled in memory
+enum class image_format : uint8_t { PNG, JPEG, TIFF, BMP, PNM, PFM, CIMG };
+
+/**
+ * Parses a format name or file extension (case-insensitive, with or
+ * without a leading dot). Throws a ValueError for unknown formats.
+ */
+image_format parse_format(std::string_view name);
+
+/// Guesses the format of encoded data from its first bytes
+std::optional<image_format> sniff_format(const uint8_t *data, size_t size);
+
+/**
+ * Decodes an image from memory, like loading it from a file would: frames
+ * of multi-frame formats are stacked along the z axis. The format is
+ * guessed from the data if not given.
+ */
+cimg_library::CImg<gmic_pixel_type> image_from_bytes(
+    const byte_array &data, const std::optional<std::string> &format);
+
+/**
+ * Decodes every frame of an image from memory, appending them to list.
+ * Returns the room reserved for them under the memory limit, to be kept
+ * until they are counted as live.
+ */
+[[nodiscard]] memory_limit::reservation list_from_bytes(
+    cimg_library::CImgList<gmic_pixel_type> &list, const byte_array &data,
+    const std::optional<std::string> &format);
+
+/**
+ * Encodes an image in the given format, with the GIL released. Options
+ * depend on the format: quality (JPEG), bytes_per_pixel (PNG and PNM),
+ * compression ('none', 'lzw' or 'jpeg' for TIFF, a bool for .cimg)
+ */
+nanobind::bytes image_to_bytes(const cimg_library::CImg<gmic_pixel_type> &img,
+                               const std::string &format,
+                               const nanobind::kwargs &options);
+
+/**
+ * Encodes a list of images, as several frames for TIFF and .cimg. Other
+ * formats can only hold a single image.
+ */
+nanobind::bytes list_to_bytes(
+    const cimg_library::CImgList<gmic_pixel_type> &list,
+    const std::string &format, const nanobind::kwargs &options);
+
+/**
+ * Decodes images from paths or bytes-like objects on a pool of threads
+ * leased from the thread budget (up to threads, 0 for the whole budget),
+ * appending them to list in order. The GIL is released while decoding.
+ * Returns the room reserved for them like list_from_bytes().
+ */
+[[nodiscard]] memory_limit::reservation decode_many(
+    cimg_library::CImgList<gmic_pixel_type> &list,
+    const nanobind::handle &sources, const std::optional<std::string> &format,
+    unsigned int threads);
+
+/// Encodes images on a pool of threads, returning a list of bytes in order
+nanobind::list encode_many(
+    const std::vector<const cimg_library::CImg<gmic_pixel_type> *> &images,
+    const std::string &format, const nanobind::kwargs &options,
+    unsigned int threads);
+
+}  // namespace gmicpy
+
+#endif  // CODECS_HPP
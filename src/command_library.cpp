@@ -0,0 +1,159 @@
+#include "command_library.hpp"
+
+#include <fstream>
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+
+/// Returns the name of the command defined on the given line, if any
+static optional<string_view> definition_name(const string_view line)
+{
+    size_t i = 0;
+    if (i < line.size() && line[i] == '+')
+        ++i;
+    const size_t begin = i;
+    while (i < line.size() &&
+           (isalnum(static_cast<unsigned char>(line[i])) || line[i] == '_'))
+        ++i;
+    if (i == begin || isdigit(static_cast<unsigned char>(line[begin])))
+        return {};
+    const size_t end = i;
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t'))
+        ++i;
+    if (i >= line.size() || line[i] != ':')
+        return {};
+    return line.substr(begin, end - begin);
+}
+
+command_library::command_library(string source, string origin)
+    : source(std::move(source)),
+      origin(std::move(origin)),
+      version(hash<string>{}(this->source))
+{
+    index();
+}
+
+void command_library::index()
+{
+    string current;
+    size_t start = 0;
+    const auto close = [&](const size_t end) {
+        if (!current.empty())
+            definitions[current] = {start, end - start};
+    };
+    for (size_t pos = 0; pos < source.size();) {
+        auto eol = source.find('\n', pos);
+        if (eol == string::npos)
+            eol = source.size();
+        if (const auto name =
+                definition_name(string_view(source).substr(pos, eol - pos))) {
+            close(pos);
+            current = *name;
+            start = pos;
+            if (!definitions.contains(current))
+                names.push_back(current);
+        }
+        pos = eol + 1;
+    }
+    close(source.size());
+    LOG_DEBUG("Indexed " << names.size() << " command(s) from " << origin
+                         << endl);
+}
+
+string_view command_library::definition(const string &name) const
+{
+    const auto def = definitions.find(name);
+    if (def == definitions.end())
+        throw nb::key_error(name.c_str());
+    return string_view(source).substr(def->second.first, def->second.second);
+}
+
+shared_ptr<command_library> command_library::load(const nb::handle &source)
+{
+    optional<filesystem::path> path;
+    string text;
+    if (nb::isinstance<nb::str>(source)) {
+        text = nb::cast<string>(source);
+        error_code err;
+        if (text.find('\n') == string::npos &&
+            filesystem::is_regular_file(text, err))
+            path = text;
+    }
+    else {
+        path = nb::cast<filesystem::path>(source);
+    }
+
+    // Libraries are shared as long as one of them is alive, keyed by their
+    // file's identity or by their text
+    static mutex cache_mtx;
+    static unordered_map<string, weak_ptr<command_library>> cache;
+    string key;
+    if (path) {
+        const auto canon = filesystem::canonical(*path);
+        key = "file:" + canon.string() + ':' +
+              to_string(filesystem::file_size(canon)) + ':' +
+              to_string(filesystem::last_write_time(canon)
+                            .time_since_epoch()
+                            .count());
+    }
+    else {
+        key = "text:" + to_string(hash<string>{}(text));
+    }
+
+    lock_guard lock(cache_mtx);
+    if (const auto cached = cache[key].lock();
+        cached && (path || cached->get_source() == text))
+        return cached;
+    if (path) {
+        ifstream file(*path, ios::binary);
+        if (!file)
+            throw runtime_error("Couldn't read command library file " +
+                                path->string());
+        text.assign(istreambuf_iterator<char>(file),
+                    istreambuf_iterator<char>());
+    }
+    auto lib = make_shared<command_library>(
+        std::move(text), path ? path->string() : string("<string>"));
+    cache[key] = lib;
+    erase_if(cache, [](const auto &entry) { return entry.second.expired(); });
+    return lib;
+}
+
+void command_library::bind(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic." << CLASSNAME << " class" << endl);
+    nb::class_<command_library>(
+        m, CLASSNAME,
+        "Immutable library of custom G'MIC commands, read and indexed once "
+        "and attachable to any number of interpreters")
+        .def_static("load", &command_library::load, "source"_a,
+                    "Loads a library from a path-like object, or from a "
+                    "string which is either the path of an existing file or "
+                    "G'MIC command definitions. Loading the same file or text "
+                    "again returns the same library while it is alive")
+        .def_prop_ro("names", &command_library::get_names,
+                     "Names of the commands defined by the library, in "
+                     "definition order")
+        .def_prop_ro("origin", &command_library::get_origin,
+                     "Path of the file the library was loaded from, or "
+                     "'<string>'")
+        .def_prop_ro("version", &command_library::get_version,
+                     "Hash identifying the library's contents")
+        .def_prop_ro("source", &command_library::get_source,
+                     "Source text of the library")
+        .def("__contains__", &command_library::contains, "name"_a)
+        .def("__getitem__", &command_library::definition, "name"_a,
+             "Returns the source of the definition of the given command")
+        .def("__len__",
+             [](const command_library &lib) { return lib.get_names().size(); })
+        .def("__repr__", [](const command_library &lib) {
+            stringstream out;
+            out << '<' << CLASSNAME << " from " << lib.get_origin() << ", "
+                << lib.get_names().size() << " command(s)>";
+            return out.str();
+        });
+}
+
+}  // namespace gmicpy
@@ -0,0 +1,58 @@
+#ifndef COMMAND_LIBRARY_HPP
+#define COMMAND_LIBRARY_HPP
+#include "gmicpy.hpp"
+
+namespace gmicpy {
+
+/**
+ * Immutable library of custom G'MIC commands. Its source is read and
+ * indexed once, after which it can be attached to any number of
+ * interpreters. Libraries loaded from the same file (or text) are shared
+ * process-wide as long as one of them is alive.
+ */
+class command_library {
+    std::string source;
+    std::string origin;
+    std::vector<std::string> names;
+    /// Offset and length of each command definition in source
+    std::unordered_map<std::string, std::pair<size_t, size_t>> definitions;
+    size_t version;
+
+    void index();
+
+   public:
+    constexpr static auto CLASSNAME = "CommandLibrary";
+
+    command_library(std::string source, std::string origin);
+    command_library(const command_library &) = delete;
+    command_library &operator=(const command_library &) = delete;
+
+    /**
+     * Loads a library from a path-like object, or from a string which is
+     * either the path of an existing file or command definitions text
+     */
+    static std::shared_ptr<command_library> load(
+        const nanobind::handle &source);
+
+    [[nodiscard]] const std::string &get_source() const { return source; }
+    [[nodiscard]] const std::string &get_origin() const { return origin; }
+    [[nodiscard]] const std::vector<std::string> &get_names() const
+    {
+        return names;
+    }
+    /// Hash of the library's source, identifying its contents
+    [[nodiscard]] size_t get_version() const { return version; }
+
+    [[nodiscard]] bool contains(const std::string &name) const
+    {
+        return definitions.contains(name);
+    }
+    /// Returns the source of the given command's definition
+    [[nodiscard]] std::string_view definition(const std::string &name) const;
+
+    static void bind(nanobind::module_ &m);
+};
+
+}  // namespace gmicpy
+
+#endif  // COMMAND_LIBRARY_HPP
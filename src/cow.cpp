@@ -0,0 +1,168 @@
+#include "cow.hpp"
+
+#include "memory.hpp"
+#include "utils.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+using namespace cimg_library;
+
+cow_registry COW;
+
+void cow_registry::set_enabled(const bool enabled)
+{
+    this->enabled = enabled;
+}
+
+bool cow_registry::is_enabled() const { return enabled; }
+
+bool cow_registry::is_member(const Img &img) const
+{
+    if (!img.is_shared())
+        return false;
+    lock_guard lock(mtx);
+    return buffers.contains(img.data());
+}
+
+bool cow_registry::is_pinned(const Img &img) const
+{
+    lock_guard lock(mtx);
+    return pinned.contains(&img);
+}
+
+size_t cow_registry::held_bytes(const Img &img) const
+{
+    if (!img.is_shared())
+        return owned_bytes(img);
+    lock_guard lock(mtx);
+    const auto it = buffers.find(img.data());
+    return it == buffers.end() ? 0 : it->second.bytes;
+}
+
+cow_registry::Img cow_registry::copy(Img &src)
+{
+    if (enabled && src.data()) {
+        lock_guard lock(mtx);
+        auto it = buffers.find(src.data());
+        if (!src.is_shared() && !pinned.contains(&src)) {
+            // src becomes the first user of its own buffer
+            it = buffers.emplace(src.data(), buffer{owned_bytes(src), 1})
+                     .first;
+            src._is_shared = true;
+        }
+        if (it != buffers.end()) {
+            it->second.users++;
+            return Img(src.data(), src._width, src._height, src._depth,
+                       src._spectrum, true);
+        }
+    }
+    return Img(src, false);
+}
+
+size_t cow_registry::copy_bytes(const Img &src) const
+{
+    if (enabled && src.data()) {
+        lock_guard lock(mtx);
+        if (src.is_shared() ? buffers.contains(src.data())
+                            : !pinned.contains(&src))
+            return 0;
+    }
+    return src.size() * sizeof(T);
+}
+
+void cow_registry::detach(Img &img)
+{
+    if (!img.is_shared())
+        return;
+    {
+        lock_guard lock(mtx);
+        const auto it = buffers.find(img.data());
+        if (it == buffers.end())
+            return;
+        if (it->second.users == 1) {
+            buffers.erase(it);
+            img._is_shared = false;
+            return;
+        }
+    }
+    // Copied while still holding a reference, which keeps the buffer alive
+    const auto room = MEMORY.reserve(img.size() * sizeof(T));
+    Img copy(img, false);
+    STATS.copied(copy_path::IMAGE_COPY, owned_bytes(copy));
+    STATS.image_resized(0, owned_bytes(copy));
+    release(img);
+    copy.swap(img);
+}
+
+void cow_registry::pin(Img &img)
+{
+    detach(img);
+    if (!img.data() || img.is_shared())
+        return;
+    lock_guard lock(mtx);
+    pinned.insert(&img);
+}
+
+void cow_registry::release(Img &img)
+{
+    if (!img.data())
+        return;
+    {
+        lock_guard lock(mtx);
+        if (!img.is_shared()) {
+            // The buffer is about to be freed, along with the pin of the
+            // views exported from it
+            pinned.erase(&img);
+            return;
+        }
+        const auto it = buffers.find(img.data());
+        if (it == buffers.end())
+            return;
+        if (--it->second.users == 0) {
+            STATS.image_resized(it->second.bytes, 0);
+            buffers.erase(it);
+            delete[] img._data;
+        }
+    }
+    img.assign();
+}
+
+void cow_registry::move(Img &src, Img &dst)
+{
+    release(dst);
+    if (!is_member(src)) {
+        src.move_to(dst);
+    }
+    else if (dst.is_shared()) {
+        // dst is a view, whose values are overwritten as by move_to()
+        dst.assign(src);
+        release(src);
+    }
+    else {
+        dst.assign();
+        src.swap(dst);
+    }
+}
+
+void bind_cow(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic copy-on-write functions" << endl);
+    m.def(
+        "set_copy_on_write",
+        [](const bool enabled) { COW.set_enabled(enabled); }, "enabled"_a,
+        "Enables or disables copy-on-write image copies (disabled by "
+        "default). When enabled, +img, Image.assign_copy(other) and items "
+        "set or inserted into an ImageList share the buffer of the image "
+        "they copy, which is only duplicated when either of them is about "
+        "to be modified (by operators, fill, eval or lazy outputs, "
+        "writable exports such as as_numpy, or Gmic.run), and dropped "
+        "without copying when replaced by assign methods. Images that "
+        "views or arrays were exported from are always copied");
+    m.def(
+        "get_copy_on_write", [] { return COW.is_enabled(); },
+        "Returns whether image copies are copy-on-write");
+}
+
+}  // namespace gmicpy
@@ -0,0 +1,84 @@
+#ifndef COW_HPP
+#define COW_HPP
+#include <unordered_set>
+
+#include "gmicpy.hpp"
+
+namespace gmicpy {
+
+/**
+ * Process-wide registry of the buffers shared by copy-on-write image copies.
+ * When enabled, copying an image turns it and its copy into shared images of
+ * the same buffer, which is reference counted here and only duplicated when
+ * one of them is about to be modified. Buffers that views or arrays were
+ * exported from are never shared, so that writes through such views keep
+ * reaching the image only.
+ */
+class cow_registry {
+    using T = gmic_pixel_type;
+    using Img = cimg_library::CImg<T>;
+
+    struct buffer {
+        size_t bytes;
+        size_t users;
+    };
+
+    mutable std::mutex mtx;
+    std::unordered_map<const T *, buffer> buffers;
+    /// Images with exported views, whose buffers can't be shared. Kept
+    /// whether copy-on-write is enabled or not, as stealing pinned images
+    /// copies them instead.
+    std::unordered_set<const Img *> pinned;
+    std::atomic<bool> enabled = false;
+
+   public:
+    void set_enabled(bool enabled);
+    [[nodiscard]] bool is_enabled() const;
+
+    /// Whether img is a copy-on-write image, sharing a registered buffer
+    [[nodiscard]] bool is_member(const Img &img) const;
+
+    /// Whether views were exported from img's current buffer
+    [[nodiscard]] bool is_pinned(const Img &img) const;
+
+    /**
+     * Bytes of img's buffer, if img owns it or shares a registered one
+     * (copying an image makes both of them share it), otherwise 0
+     */
+    [[nodiscard]] size_t held_bytes(const Img &img) const;
+
+    /**
+     * Copy of src: a shared image of its buffer if copy-on-write is enabled
+     * and src owns its buffer (or shares a registered one), otherwise a deep
+     * copy
+     */
+    Img copy(Img &src);
+
+    /// Bytes copy(src) allocates: none if the copy would share src's buffer
+    [[nodiscard]] size_t copy_bytes(const Img &src) const;
+
+    /**
+     * Gives img a buffer of its own before it is modified, copying the
+     * shared one unless img is its last user
+     */
+    void detach(Img &img);
+
+    /// Detaches img, and keeps its buffer from being shared from now on
+    void pin(Img &img);
+
+    /**
+     * Drops img's reference to its buffer (emptying img) if it is a
+     * copy-on-write image, and its pin otherwise, before it is destroyed
+     * or its buffer replaced
+     */
+    void release(Img &img);
+
+    /// CImg::move_to(), keeping copy-on-write images shared
+    void move(Img &src, Img &dst);
+};
+
+extern cow_registry COW;
+
+}  // namespace gmicpy
+
+#endif  // COW_HPP
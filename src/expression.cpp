@@ -0,0 +1,217 @@
+#include "expression.hpp"
+
+#include "utils.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+using namespace cimg_library;
+
+/// Minimum number of values for parallelizable expressions to use threads
+constexpr size_t PARALLEL_VALUES = 4096;
+
+/// Variables of CImg's math parser folded from the values of the image
+static bool is_stats_variable(const string_view name)
+{
+    static constexpr string_view STATS_VARIABLES[] = {
+        "im", "iM", "ia", "iv", "id", "is", "ip", "ic", "in",
+        "xm", "ym", "zm", "cm", "xM", "yM", "zM", "cM"};
+    return ranges::find(STATS_VARIABLES, name) != ranges::end(STATS_VARIABLES);
+}
+
+/// Whether an expression refers to a statistic of the image
+static bool uses_image_stats(const string_view source)
+{
+    const auto is_word = [](const char c) {
+        return isalnum(static_cast<unsigned char>(c)) || c == '_';
+    };
+    for (size_t i = 0; i < source.size();) {
+        if (!is_word(source[i])) {
+            i++;
+            continue;
+        }
+        size_t end = i;
+        while (end < source.size() && is_word(source[end]))
+            end++;
+        if (is_stats_variable(source.substr(i, end - i)))
+            return true;
+        i = end;
+    }
+    return false;
+}
+
+expression_py::expression_py(string source)
+    : source(std::move(source)),
+      order(this->source.empty() ||
+                    string_view("<>*:").find(this->source[0]) ==
+                        string_view::npos
+                ? 0
+                : this->source[0]),
+      uses_stats(uses_image_stats(this->source))
+{
+    if (this->source.size() == (order ? 1 : 0))
+        throw invalid_argument("Empty expression");
+}
+
+shared_ptr<expression_py::compiled> expression_py::compiled_for(
+    const Img &img)
+{
+    const shape_key shape{img._width, img._height, img._depth,
+                          img._spectrum};
+    lock_guard lock(mtx);
+    const auto it =
+        ranges::find(cache, shape, &decltype(cache)::value_type::first);
+    if (it != cache.end()) {
+        cache.splice(cache.begin(), cache, it);
+    }
+    else {
+        if (cache.size() >= CACHE_SIZE)
+            cache.pop_back();
+        cache.emplace_front(shape, make_shared<compiled>());
+    }
+    return cache.front().second;
+}
+
+void expression_py::eval(const Img &img, Img &out)
+{
+    if (!img.is_sameXYZC(out))
+        throw invalid_argument(
+            "Expression output must have the shape of its input");
+    const auto compiled_ptr =
+        uses_stats ? make_shared<compiled>() : compiled_for(img);
+    auto &entry = *compiled_ptr;
+    lock_guard lock(entry.mtx);
+
+    const auto bind_input = [&](const Img &input) {
+        entry.input.assign(input.data(), input.width(), input.height(),
+                           input.depth(), input.spectrum(), true);
+    };
+    bind_input(img);
+    entry.output.assign(out.data(), out.width(), out.height(), out.depth(),
+                        out.spectrum(), true);
+    if (!entry.mp) {
+        LOG_DEBUG("Compiling '" << source << "' for " << img_to_string(img)
+                                << endl);
+        entry.mp = make_unique<parser>(source.c_str() + (order ? 1 : 0),
+                                       "gmic.Expression", entry.input,
+                                       &entry.output, nullptr, nullptr, true);
+    }
+
+    // Like CImg::fill(), reads from a copy when points written may be read
+    Img input_copy;
+    if (overlaps(img, out) &&
+        (entry.mp->need_input_copy || img.data() != out.data())) {
+        input_copy.assign(img);
+        STATS.copied(copy_path::IMAGE_COPY, owned_bytes(input_copy));
+        bind_input(input_copy);
+    }
+    evaluate(*entry.mp, entry.output);
+}
+
+void expression_py::evaluate(parser &mp, Img &out) const
+{
+    const int W = out.width(), H = out.height(), D = out.depth();
+    const bool is_vector = mp.result_dim > 0;
+    const unsigned int N =
+        min(mp.result_dim, static_cast<unsigned int>(out.spectrum()));
+    const size_t whd = static_cast<size_t>(W) * H * D,
+                 res_size = max(mp.result_dim, 1U);
+    // Rows along x, of one channel for scalar expressions
+    const long rows =
+        static_cast<long>(H) * D * (is_vector ? 1 : out.spectrum());
+    const bool reverse = order == '<';
+    const auto eval_row = [&](parser &p, double *res, const long r) {
+        const auto y = static_cast<int>(r % H),
+                   z = static_cast<int>(r / H % D),
+                   c = static_cast<int>(r / (H * D));
+        T *ptr = out.data(0, y, z, c);
+        for (int i = 0; i < W; i++) {
+            const int x = reverse ? W - 1 - i : i;
+            if (is_vector) {
+                p(x, y, z, 0, res);
+                for (unsigned int n = 0; n < N; n++)
+                    ptr[x + n * whd] = static_cast<T>(res[n]);
+            }
+            else {
+                ptr[x] = static_cast<T>(p(x, y, z, c));
+            }
+        }
+    };
+
+    bool parallel = false;
+#if cimg_use_openmp != 0
+    parallel = order == '*' || order == ':' ||
+               (!order && mp.is_parallelizable &&
+                out.size() >= PARALLEL_VALUES);
+#endif
+    if (!parallel) {
+        vector<double> res(res_size);
+        mp.begin_t();
+        for (long i = 0; i < rows; i++)
+            eval_row(mp, res.data(), reverse ? rows - 1 - i : i);
+        mp.end_t();
+    }
+#if cimg_use_openmp != 0
+    else {
+        // Same scheme as CImg::fill(): threads other than the first one
+        // evaluate with copies of the parser, merged back at the end
+        exception_ptr error;
+        cimg_pragma_openmp(parallel)
+        {
+            unique_ptr<parser> copy;
+            if (omp_get_thread_num())
+                copy = make_unique<parser>(mp);
+            parser &lmp = copy ? *copy : mp;
+            cimg_pragma_openmp(barrier)
+            lmp.begin_t();
+            vector<double> res(res_size);
+            cimg_pragma_openmp(for)
+            for (long r = 0; r < rows; r++) {
+                try {
+                    eval_row(lmp, res.data(), r);
+                }
+                catch (...) {
+                    cimg_pragma_openmp(critical)
+                    {
+                        if (!error)
+                            error = current_exception();
+                    }
+                }
+            }
+            lmp.end_t();
+            cimg_pragma_openmp(barrier)
+            cimg_pragma_openmp(critical)
+            {
+                lmp.merge(mp);
+            }
+        }
+        if (error)
+            rethrow_exception(error);
+    }
+#endif
+    mp.end();
+}
+
+void expression_py::bind(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic." << CLASSNAME << " class" << endl);
+    nb::class_<expression_py>(
+        m, CLASSNAME,
+        "Math expression (as for Image.fill) compiled once and reused by "
+        "Image.fill and Image.eval. It is compiled for each image shape it "
+        "is evaluated on, begin() blocks running at that time only. "
+        "Expressions using image statistics (im, iM, ia...) are compiled on "
+        "every call")
+        .def(nb::init<string>(), "source"_a)
+        .def_prop_ro("source", &expression_py::get_source)
+        .def("__repr__", [](const expression_py &expr) {
+            return "gmic.Expression(" +
+                   string(nb::repr(nb::str(expr.source.c_str())).c_str()) +
+                   ")";
+        });
+}
+
+void bind_expression(nb::module_ &m) { expression_py::bind(m); }
+
+}  // namespace gmicpy
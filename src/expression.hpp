@@ -0,0 +1,70 @@
+#ifndef EXPRESSION_HPP
+#define EXPRESSION_HPP
+#include <list>
+
+#include "gmicpy.hpp"
+
+namespace gmicpy {
+
+/**
+ * Math expression compiled once per image shape and evaluated at every point
+ * of images, like CImg::fill() does with a formula but without compiling it
+ * again on each call. CImg's math parser folds the shape of its image (w, h,
+ * whd...) into the compiled code, so a parser is kept for each shape met;
+ * the images it reads and writes are shared views that are pointed at the
+ * images of each evaluation, for the last few shapes used. Expressions
+ * using the statistics of the image (im, iM, ia...), which are folded as
+ * well, are compiled on every call.
+ */
+class expression_py {
+    using T = gmic_pixel_type;
+    using Img = cimg_library::CImg<T>;
+    using parser = Img::_cimg_math_parser;
+    using shape_key = std::array<unsigned int, 4>;
+
+    /// Parser compiled for one shape, with the views it is bound to
+    struct compiled {
+        std::mutex mtx;
+        Img input{}, output{};
+        std::unique_ptr<parser> mp{};
+    };
+
+    const std::string source;
+    /// Evaluation order prefix of the source ('<', '>', '*', ':' or 0)
+    const char order;
+    /// Whether the compiled code depends on the values of the image
+    const bool uses_stats;
+
+    /// Number of shapes whose parsers are kept
+    constexpr static size_t CACHE_SIZE = 8;
+
+    std::mutex mtx;
+    /// Parsers by shape, most recently used first. Shared with the
+    /// evaluations using them, which may outlive their eviction.
+    std::list<std::pair<shape_key, std::shared_ptr<compiled>>> cache;
+
+    std::shared_ptr<compiled> compiled_for(const Img &img);
+
+    /// Evaluates a bound parser at every point of out
+    void evaluate(parser &mp, Img &out) const;
+
+   public:
+    constexpr static auto CLASSNAME = "Expression";
+
+    explicit expression_py(std::string source);
+
+    [[nodiscard]] const std::string &get_source() const { return source; }
+
+    /**
+     * Evaluates the expression at every point of img into out, which must
+     * have the same shape and may be img itself. Thread-safe, to be called
+     * without the GIL.
+     */
+    void eval(const Img &img, Img &out);
+
+    static void bind(nanobind::module_ &m);
+};
+
+}  // namespace gmicpy
+
+#endif  // EXPRESSION_HPP
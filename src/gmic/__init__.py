@@ -0,0 +1,37 @@
+"""Python bindings for the G'MIC C++ image processing library
+
+The bindings and libgmic are built once per instruction set, as
+gmic._core_<isa> modules, and this package imports the best one the CPU
+supports, or the one named by the GMICPY_ISA environment variable.
+Only one of them can be imported per process, as they bind the same types.
+"""
+import importlib as _importlib
+import importlib.util as _importlib_util
+import os as _os
+import warnings as _warnings
+
+from . import _isa
+
+# Instruction sets the modules can be built for, in increasing order of
+# requirements
+_ISAS = ("baseline", "avx2", "avx512")
+
+
+def _select_isa(built: "list[str]") -> str:
+    available = [isa for isa in built if _isa.cpu_supports(isa)]
+    name = _os.environ.get("GMICPY_ISA")
+    if not name or name in available:
+        return name or available[-1]
+    _warnings.warn(f"GMICPY_ISA={name} isn't available on this build and CPU, using {available[-1]}",
+                   RuntimeWarning, stacklevel=2)
+    return available[-1]
+
+
+_built = [isa for isa in _ISAS if _importlib_util.find_spec(f"{__name__}._core_{isa}") is not None]
+_core = _importlib.import_module(f"{__name__}._core_{_select_isa(_built)}")
+# The module names itself gmic, its dunder attributes are re-exported too
+globals().update((name, value) for name, value in vars(_core).items()
+                 if not name.startswith("__") or name in ("__version__", "__pyversion__", "__build__",
+                                                          "__build_flags__"))
+__build_flags__["GMICPY_MODULE"] = _core.__spec__.name
+__build_flags__["GMICPY_ISA_VARIANTS"] = ",".join(_built)
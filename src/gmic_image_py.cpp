@@ -1,7 +1,15 @@
 #include <utility>
 
+#include "codecs.hpp"
+#include "cow.hpp"
+#include "expression.hpp"
 #include "gmicpy.hpp"
+#include "kernels.hpp"
+#include "lazy_image.hpp"
+#include "memory.hpp"
 #include "nb_ndarray_buffer.hpp"
+#include "operators.hpp"
+#include "reductions.hpp"
 #include "utils.hpp"
 
 namespace gmicpy {
@@ -36,6 +44,10 @@ class gmic_image_py {
     using CTNDArray = nb::ndarray<const T, nb::device::cpu, P...>;
 
     constexpr static auto CLASSNAME = "Image";
+    constexpr static auto CLASSDOC =
+        "G'MIC Image. An image may be read by several threads at once, but "
+        "must not be modified (which includes copying it or exporting views "
+        "of it while copy-on-write is enabled) while other threads use it";
 
     // ReSharper disable CppTemplateParameterNeverUsed
     template <class I, class... Args>
@@ -47,9 +59,107 @@ class gmic_image_py {
         enable_if_t<is_same_v<Img, decltype(Img(declval<Args>()...))>, Img>,
         Args...> : true_type {};
 
+    /// Bytes an image assigned from args will own, 0 if unknown beforehand
+    template <class... Args>
+    static size_t expected_bytes(const Args &...)
+    {
+        return 0;
+    }
+
+    static size_t expected_bytes(const unsigned int w, const unsigned int h,
+                                 const unsigned int d, const unsigned int c,
+                                 const T &)
+    {
+        return size_t{w} * h * d * c * sizeof(T);
+    }
+
+    static size_t expected_bytes(const unsigned int w, const unsigned int h,
+                                 const unsigned int d, const unsigned int c,
+                                 const char *, bool)
+    {
+        return expected_bytes(w, h, d, c, T{});
+    }
+
+    static size_t expected_bytes(const Img &other, const bool is_shared)
+    {
+        return is_shared ? 0 : other.size() * sizeof(T);
+    }
+
+    /**
+     * Size of CImg::assign(other, dimensions): up to 4 sizes, each a number,
+     * a percentage of other's size along the same axis, or one of other's
+     * sizes (x/w, y/h, z/d or c/v/s), separated by any other characters
+     */
+    static size_t expected_bytes(const Img &other, const char *dimensions)
+    {
+        const array<size_t, 4> sizes{other._width, other._height,
+                                     other._depth, other._spectrum};
+        if (!dimensions || !*dimensions)
+            return other.size() * sizeof(T);
+        array<size_t, 4> dims{0, 1, 1, 1};
+        const char *s = dimensions;
+        for (size_t k = 0; k < 4; k++) {
+            while (*s && !isdigit(static_cast<unsigned char>(*s)) &&
+                   !strchr("xyzcwhdvsXYZCWHDVS", *s))
+                s++;
+            if (!*s)
+                break;
+            if (isdigit(static_cast<unsigned char>(*s))) {
+                char *end;
+                dims[k] = strtoul(s, &end, 10);
+                s = end;
+                if (*s == '%') {
+                    dims[k] = dims[k] * sizes[k] / 100;
+                    s++;
+                }
+                continue;
+            }
+            switch (tolower(static_cast<unsigned char>(*s++))) {
+                case 'x':
+                case 'w':
+                    dims[k] = sizes[0];
+                    break;
+                case 'y':
+                case 'h':
+                    dims[k] = sizes[1];
+                    break;
+                case 'z':
+                case 'd':
+                    dims[k] = sizes[2];
+                    break;
+                default:
+                    dims[k] = sizes[3];
+                    break;
+            }
+        }
+        return dims[0] * dims[1] * dims[2] * dims[3] * sizeof(T);
+    }
+
+    template <class... P>
+    static size_t expected_bytes(const CTNDArray<P...> &arr)
+    {
+        return arr.size() * sizeof(T);
+    }
+
+    template <class Ti, class... P>
+    static size_t expected_bytes(
+        const nb::ndarray<Ti, nb::device::cpu, P...> &arr)
+    {
+        return arr.size() * sizeof(T);
+    }
+
+    /// Bytes more than before that an image needs
+    static size_t growth(const size_t before, const size_t after)
+    {
+        return after - min(after, before);
+    }
+
     template <class... Args>
     static void new_image(Img *img, Args... args)
     {
+        // Room is reserved before allocating if the size is known from the
+        // arguments, and checked once allocated otherwise
+        auto room = MEMORY.reserve(expected_bytes(args...));
         if constexpr (can_native_init<Img, Args...>::value) {
             new (img) Img(args...);
             LOG_SIG(Debug, new_image, ARGS(Img &, Args...),
@@ -61,6 +171,92 @@ class gmic_image_py {
             LOG_SIG(Debug, assign, ARGS(Img &, Args...),
                     img_to_string(*img) << endl);
         }
+        count_copy(*img, args...);
+        try {
+            room.grow(owned_bytes(*img));
+        }
+        catch (...) {
+            img->~Img();
+            throw;
+        }
+        STATS.image_allocated(owned_bytes(*img));
+    }
+
+    static void new_image(Img *img, Img &other, const bool is_shared)
+    {
+        new (img) Img();
+        STATS.image_allocated(0);  // Bytes are counted when assigning data
+        tracked_assign(*img, other, is_shared);
+    }
+
+    /// Whether an argument of assign() is the assigned image itself
+    static bool is_image(const Img &img, const Img &arg)
+    {
+        return &img == &arg;
+    }
+
+    template <class A>
+    static bool is_image(const Img &, const A &)
+    {
+        return false;
+    }
+
+    /**
+     * Assigns an image in place, keeping the live bytes counter up to date.
+     * As the image is replaced, its reference to a copy-on-write buffer is
+     * dropped rather than copied, unless it is also read by assign().
+     */
+    template <class... Args>
+    static Img &tracked_assign(Img &img, Args... args)
+    {
+        if (COW.is_member(img) && !(is_image(img, args) || ...))
+            COW.release(img);
+        else
+            COW.detach(img);
+        const auto before = owned_bytes(img);
+        auto room = MEMORY.reserve(growth(before, expected_bytes(args...)));
+        assign(img, args...);  // NOLINT(*-unnecessary-value-param)
+        count_copy(img, args...);
+        try {
+            room.grow(growth(before, owned_bytes(img)));
+        }
+        catch (...) {
+            // The image was already replaced, and is left empty
+            img.assign();
+            STATS.image_resized(before, 0);
+            throw;
+        }
+        STATS.image_resized(before, owned_bytes(img));
+        return img;
+    }
+
+    /// assign_copy(), sharing other's buffer if copies are copy-on-write
+    static Img &tracked_assign(Img &img, Img &other, const bool is_shared)
+    {
+        if (is_shared)
+            COW.pin(other);
+        if (is_shared || !COW.is_enabled())
+            return tracked_assign<Img &, bool>(img, other, is_shared);
+        if (&img == &other)
+            return img;
+        const auto before = owned_bytes(img);
+        const auto room = MEMORY.reserve(COW.copy_bytes(other));
+        auto copy = COW.copy(other);
+        STATS.copied(copy_path::IMAGE_COPY, owned_bytes(copy));
+        COW.move(copy, img);
+        STATS.image_resized(before, owned_bytes(img));
+        return img;
+    }
+
+    template <class... Args>
+    static void count_copy(const Img &, Args &&...)
+    {
+    }
+
+    static void count_copy(const Img &img, Img &, const bool is_shared)
+    {
+        if (!is_shared)
+            STATS.copied(copy_path::IMAGE_COPY, owned_bytes(img));
     }
 
     template <class... Args>
@@ -110,6 +306,7 @@ class gmic_image_py {
                     << strides[1] << ", " << strides[2] << ", " << strides[3]
                     << ")");
 
+        STATS.copied(copy_path::NDARRAY_TO_IMAGE, owned_bytes(img));
         if (is_f_contig(arr)) {
             LOG << ", F-contig (std::copy_n)" << endl;
             copy_n(arr.data(), arr.size(), img.data());
@@ -148,6 +345,7 @@ class gmic_image_py {
                 img_to_string(img) << endl);
         CImg<Ti> img2(arr);
         img.assign(img2);
+        STATS.copied(copy_path::NDARRAY_TO_IMAGE, owned_bytes(img));
         return img;
     }
 
@@ -163,6 +361,13 @@ class gmic_image_py {
                                               imgh, strides_v.data());
     }
 
+    /// Writable view of the image's data, which is thus no longer shared
+    static auto as_numpy(const nb::handle &imgh)
+    {
+        COW.pin(nb::cast<Img &>(imgh));
+        return as_ndarray<nb::numpy>(imgh);
+    }
+
     static auto dlpack_device(Img &)
     {
         return nb::make_tuple(nb::device::cpu::value, 0);
@@ -180,15 +385,65 @@ class gmic_image_py {
             throw nb::value_error(
                 "Unsupported __dlpack__ dl_device, only CPU is supported");
 
+        if (!copy || !*copy) {
+            COW.pin(nb::cast<Img &>(img));
+            return as_ndarray<>(img).cast(nb::rv_policy::reference);
+        }
         auto array = as_ndarray<>(img);
-        return !copy || !*copy ? array.cast(nb::rv_policy::reference)
-                               : array.cast(nb::rv_policy::copy);
+        STATS.copied(copy_path::IMAGE_TO_NDARRAY, array.nbytes());
+        return array.cast(nb::rv_policy::copy);
+    }
+
+    static nb::object to_numpy(const nb::handle &img)
+    {
+        auto array = as_ndarray<nb::numpy>(img);
+        STATS.copied(copy_path::IMAGE_TO_NDARRAY, array.nbytes());
+        return array.cast(nb::rv_policy::copy);
+    }
+
+    static Img copy(Img &img)
+    {
+        const auto room = MEMORY.reserve(COW.copy_bytes(img));
+        auto result = COW.copy(img);
+        STATS.copied(copy_path::IMAGE_COPY, owned_bytes(result));
+        return result;
+    }
+
+    /**
+     * Wraps nanobind's destruct, copy and move hooks of the Image type so
+     * that STATS' image counters also cover Python-owned images created or
+     * released outside of the bindings' own functions
+     */
+    static void track_lifetimes(const nb::handle &cls)
+    {
+        auto *td = nb::detail::nb_type_data(
+            reinterpret_cast<PyTypeObject *>(cls.ptr()));
+        td->destruct = [](void *p) {
+            auto *img = static_cast<Img *>(p);
+            STATS.image_freed(owned_bytes(*img));
+            COW.release(*img);
+            img->~Img();
+        };
+        td->copy = [](void *dst, const void *src) {
+            // Copy-on-write images must be registered as one more user
+            auto &img = *const_cast<Img *>(static_cast<const Img *>(src));
+            const auto *copy =
+                new (dst) Img(COW.is_member(img) ? COW.copy(img) : img);
+            STATS.copied(copy_path::IMAGE_COPY, owned_bytes(*copy));
+            STATS.image_allocated(owned_bytes(*copy));
+        };
+        td->move = [](void *dst, void *src) noexcept {
+            const auto *img =
+                new (dst) Img(std::move(*static_cast<Img *>(src)));
+            STATS.image_allocated(owned_bytes(*img));
+        };
     }
 
     static nb::object array_interface(Img &img)
     {
         LOG_TRACE(img_to_string(img) << endl);
         check_has_data(img);
+        COW.pin(img);
         nb::dict ai{};
         ai["typestr"] = get_typestr<T>().data();
         ai["data"] =
@@ -268,6 +523,9 @@ class gmic_image_py {
         "Raises a ValueError if condition is not met";
     static T get(Img &img, const nb::tuple &args)
     {
+        for (const auto &arg : args)
+            if (nb::isinstance<nb::slice>(arg))
+                throw nb::next_overload();
         check_has_data(img);
         unsigned int x = cast_coord(args[0], img.width(), "X"),
                      y = cast_coord(args[1], img.height(), "Y"), z = 0, c = 0;
@@ -301,6 +559,84 @@ class gmic_image_py {
         return img(x, y, z, c);
     }
 
+    /// First index, number of indices and step of a region along an axis
+    struct axis_range {
+        unsigned int start, size;
+        long step;
+    };
+
+    static constexpr auto get_region_doc =
+        "Returns the region selected by up to 4 indices or slices, in xyzc "
+        "order (missing trailing axes are taken whole, and integer indices "
+        "keep their axis with a size of 1). Regions that are contiguous in "
+        "memory, like a range of channels, of z-slices of one channel or of "
+        "rows of one slice, are shared views of the image's buffer; others "
+        "are copied";
+    static Img get_region(Img &img, const nb::tuple &key)
+    {
+        static constexpr const char *AXES[] = {"X", "Y", "Z", "C"};
+        check_has_data(img);
+        if (key.size() > 4)
+            throw invalid_argument(
+                "Too many indices (at most 4, in xyzc order)");
+        const auto sizes = shape<unsigned int>(img);
+        array<axis_range, 4> ranges{};
+        for (size_t a = 0; a < 4; a++) {
+            const nb::object item = a < key.size() ? key[a] : nb::none();
+            if (item.is_none()) {
+                ranges[a] = {0, sizes[a], 1};
+            }
+            else if (nb::isinstance<nb::slice>(item)) {
+                const auto [start, stop, step, size] =
+                    nb::borrow<nb::slice>(item).compute(sizes[a]);
+                ranges[a] = {static_cast<unsigned int>(start),
+                             static_cast<unsigned int>(size), step};
+            }
+            else {
+                ranges[a] = {cast_coord(item, sizes[a], AXES[a]), 1, 1};
+            }
+            if (ranges[a].size == 0)
+                return {};
+            if (ranges[a].size == 1)
+                ranges[a].step = 1;
+        }
+        const auto &[x, y, z, c] = ranges;
+
+        // The region is contiguous if the axes before the first partial one
+        // are whole, and the ones after it have a single index
+        size_t partial = 0;
+        while (partial < 4 && ranges[partial].size == sizes[partial] &&
+               ranges[partial].step == 1)
+            partial++;
+        bool contiguous = partial == 4 || ranges[partial].step == 1;
+        for (size_t a = partial + 1; a < 4; a++)
+            contiguous = contiguous && ranges[a].size == 1;
+        if (contiguous) {
+            COW.pin(img);
+            return Img(img.data(x.start, y.start, z.start, c.start), x.size,
+                       y.size, z.size, c.size, true);
+        }
+
+        Img region;
+        if (x.step == 1 && y.step == 1 && z.step == 1 && c.step == 1) {
+            region = img.get_crop(x.start, y.start, z.start, c.start,
+                                  x.start + x.size - 1, y.start + y.size - 1,
+                                  z.start + z.size - 1, c.start + c.size - 1);
+        }
+        else {
+            region.assign(x.size, y.size, z.size, c.size);
+            cimg_forXYZC(region, i, j, k, l)
+            {
+                region(i, j, k, l) = img(x.start + i * x.step,
+                                         y.start + j * y.step,
+                                         z.start + k * z.step,
+                                         c.start + l * c.step);
+            }
+        }
+        STATS.copied(copy_path::IMAGE_COPY, owned_bytes(region));
+        return region;
+    }
+
     static constexpr auto pixel_at_doc =
         "Returns a spectrum-sized (e.g 3 for RGB, 4 for RGBA) tuple, of the "
         "values at [x, y, z]. Z may be omitted if the image depth is 1.\n"
@@ -326,12 +662,410 @@ class gmic_image_py {
                              [&](unsigned int i) { return img(x, y, z, i); });
     }
 
+    /// N×k integer coordinates, in xyzc order
+    using CoordArray =
+        nb::ndarray<const int64_t, nb::ndim<2>, nb::device::cpu>;
+    /// N×k real coordinates, in xyz order
+    using PointArray = CTNDArray<nb::ndim<2>>;
+
+    /// Minimum number of points for batch accessors to use several threads
+    static constexpr size_t PARALLEL_POINTS = 4096;
+
+    /**
+     * Resolves N×k coordinates into offsets in the image data (of channel 0
+     * if k < 4), checking bounds and wrapping negative values around
+     */
+    static vector<size_t> point_offsets(const Img &img,
+                                        const CoordArray &coords)
+    {
+        static constexpr const char *AXES[] = {"X", "Y", "Z", "C"};
+        check_has_data(img);
+        const size_t k = coords.shape(1);
+        if (k < 2 || k > 4)
+            throw nb::value_error(
+                "Coordinates must have between 2 and 4 columns (x, y[, z[, "
+                "c]])");
+        if (k == 2 && img.depth() != 1)
+            throw invalid_argument("Can't omit Z if image depth is not 1");
+        const auto sizes = shape<unsigned int>(img);
+        const auto img_strides = strides(img);
+        const auto view = coords.view();
+        vector<size_t> offsets(coords.shape(0));
+        for (size_t i = 0; i < offsets.size(); i++) {
+            for (size_t j = 0; j < k; j++)
+                offsets[i] += cast_long(view(i, j), sizes[j], AXES[j]) *
+                              img_strides[j];
+        }
+        return offsets;
+    }
+
+    /// Allocates a new Numpy array, filled by fill(data) with the GIL released
+    template <class F>
+    static nb::ndarray<nb::numpy, T> new_array(
+        const initializer_list<size_t> shape, F fill)
+    {
+        size_t size = 1;
+        for (const auto dim : shape)
+            size *= dim;
+        auto *data = new T[size];
+        nb::capsule owner(
+            data, [](void *p) noexcept { delete[] static_cast<T *>(p); });
+        {
+            nb::gil_scoped_release release;
+            const auto lease = THREADS.acquire(0);
+            fill(data);
+        }
+        return nb::ndarray<nb::numpy, T>(data, shape.size(), shape.begin(),
+                                         owner);
+    }
+
+    static constexpr auto gather_doc =
+        "Returns the values at N points given as an N×k integer array of "
+        "coordinates, in xyzc order: an N×spectrum array if k is 2 (if "
+        "depth is 1) or 3, an array of N values if k is 4. Negative "
+        "coordinates are relative to the end of the axis";
+    static nb::ndarray<nb::numpy, T> gather(const Img &img,
+                                            const CoordArray &coords)
+    {
+        const auto offsets = point_offsets(img, coords);
+        const bool all_channels = coords.shape(1) < 4;
+        const size_t N = offsets.size(),
+                     C = all_channels ? img.spectrum() : 1,
+                     channel_size = strides(img)[3];
+        const auto fill = [&](T *out) {
+            const T *data = img.data();
+            cimg_pragma_openmp(parallel for cimg_openmp_if_size(
+                N, PARALLEL_POINTS))
+            for (long i = 0; i < static_cast<long>(N); i++)
+                for (size_t c = 0; c < C; c++)
+                    out[i * C + c] = data[offsets[i] + c * channel_size];
+        };
+        if (all_channels)
+            return new_array({N, C}, fill);
+        return new_array({N}, fill);
+    }
+
+    static constexpr auto scatter_doc =
+        "Sets the values at N points given as in gather(), from an "
+        "N×spectrum array of values (or N values if coordinates include "
+        "the channel). If a point appears several times, which of its "
+        "values is kept is unspecified";
+    static void scatter(Img &img, const CoordArray &coords,
+                        const CTNDArray<> &values)
+    {
+        const auto offsets = point_offsets(img, coords);
+        const bool all_channels = coords.shape(1) < 4;
+        const size_t N = offsets.size(),
+                     C = all_channels ? img.spectrum() : 1,
+                     channel_size = strides(img)[3];
+        COW.detach(img);
+        if (values.ndim() == 0 || values.ndim() > 2 ||
+            values.shape(0) != N ||
+            (values.ndim() == 2 ? values.shape(1) : 1) != C)
+            throw nb::value_error(
+                ("Values must have a shape of (" + to_string(N) +
+                 (all_channels ? ", " + to_string(C) : string()) + ")")
+                    .c_str());
+        const int64_t vstride0 = values.stride(0),
+                      vstride1 = values.ndim() == 2 ? values.stride(1) : 0;
+
+        nb::gil_scoped_release release;
+        const auto lease = THREADS.acquire(0);
+        T *data = img.data();
+        const T *src = values.data();
+        cimg_pragma_openmp(parallel for cimg_openmp_if_size(
+            N, PARALLEL_POINTS))
+        for (long i = 0; i < static_cast<long>(N); i++)
+            for (size_t c = 0; c < C; c++)
+                data[offsets[i] + c * channel_size] =
+                    src[i * vstride0 + static_cast<int64_t>(c) * vstride1];
+    }
+
+    static constexpr auto sample_doc =
+        "Returns the linearly interpolated values of all channels at N "
+        "points given as an N×2 (if depth is 1) or N×3 array of real xyz "
+        "coordinates. Points outside of the image take the value of the "
+        "nearest border, and points with NaN coordinates NaN values";
+    static nb::ndarray<nb::numpy, T> sample(const Img &img,
+                                            const PointArray &points)
+    {
+        check_has_data(img);
+        const size_t N = points.shape(0), k = points.shape(1),
+                     C = img.spectrum();
+        if (k < 2 || k > 3)
+            throw nb::value_error(
+                "Points must have 2 or 3 columns (x, y[, z])");
+        if (k == 2 && img.depth() != 1)
+            throw invalid_argument("Can't omit Z if image depth is not 1");
+        const auto view = points.view();
+        return new_array({N, C}, [&](T *out) {
+            cimg_pragma_openmp(parallel for cimg_openmp_if_size(
+                N, PARALLEL_POINTS))
+            for (long i = 0; i < static_cast<long>(N); i++) {
+                const float x = view(i, 0), y = view(i, 1),
+                            z = k == 2 ? 0 : view(i, 2);
+                // Clamping leaves NaNs as is, which can't be cast to indices
+                if (isnan(x) || isnan(y) || isnan(z)) {
+                    fill_n(out + i * C, C, numeric_limits<T>::quiet_NaN());
+                    continue;
+                }
+                for (size_t c = 0; c < C; c++)
+                    out[i * C + c] = k == 2 ? img._linear_atXY(x, y, 0, c)
+                                            : img._linear_atXYZ(x, y, z, c);
+            }
+        });
+    }
+
+    /// Image or scalar operand of an arithmetic operator
+    struct arith_operand {
+        const Img *img = nullptr;
+        T value = 0;
+    };
+
+    /// Converts an Image or a number into an operand, if possible
+    static optional<arith_operand> to_operand(const nb::handle &obj)
+    {
+        if (nb::isinstance<Img>(obj)) {
+            const auto &img = nb::cast<const Img &>(obj);
+            check_has_data(img);
+            return arith_operand{&img};
+        }
+        T value;
+        if (nb::try_cast(obj, value))
+            return arith_operand{nullptr, value};
+        return nullopt;
+    }
+
+    static kernels::shape4 operand_shape(const arith_operand &o)
+    {
+        return o.img ? shape(*o.img) : kernels::shape4{1, 1, 1, 1};
+    }
+
+    /// Shape of the result of an operation, broadcasting axes of size 1
+    static kernels::shape4 broadcast_shape(const arith_operand &a,
+                                           const arith_operand &b)
+    {
+        const auto sa = operand_shape(a), sb = operand_shape(b);
+        const auto result = kernels::broadcast(sa, sb);
+        if (!result)
+            throw nb::value_error(
+                ("Operands could not be broadcast together with shapes " +
+                 shape_to_string(sa) + " and " + shape_to_string(sb))
+                    .c_str());
+        return *result;
+    }
+
+    /// Kernel view of an operand, with null strides on broadcast axes
+    static kernels::operand<T> kernel_operand(const arith_operand &o)
+    {
+        if (!o.img)
+            return {&o.value, {}};
+        return kernels::dense_operand(o.img->data(), shape(*o.img));
+    }
+
+    /**
+     * Computes a op b into out, which must have the broadcast shape. Inputs
+     * sharing memory with out, other than exactly in place, are copied
+     * first. Large images are processed on the thread budget without the
+     * GIL.
+     */
+    static void compute(const kernels::binary_op op, arith_operand a,
+                        arith_operand b, Img &out)
+    {
+        const auto out_shape = shape(out);
+        array<Img, 2> copies;
+        size_t n = 0;
+        for (auto *o : {&a, &b}) {
+            if (o->img && overlaps(*o->img, out) &&
+                (o->img->data() != out.data() ||
+                 shape(*o->img) != out_shape)) {
+                copies[n].assign(*o->img);
+                STATS.copied(copy_path::IMAGE_COPY, owned_bytes(copies[n]));
+                o->img = &copies[n++];
+            }
+        }
+        const auto ka = kernel_operand(a), kb = kernel_operand(b);
+        if (out.size() < kernels::PARALLEL_VALUES) {
+            kernels::apply(op, out.data(), out_shape, ka, kb, 1);
+            return;
+        }
+        nb::gil_scoped_release release;
+        const auto lease = THREADS.acquire(0);
+        kernels::apply(op, out.data(), out_shape, ka, kb, lease.threads());
+    }
+
+    /// Returns a op b as a new image
+    static Img binary(const kernels::binary_op op, const arith_operand &a,
+                      const arith_operand &b)
+    {
+        const auto result_shape = broadcast_shape(a, b);
+        // Counted as live once returned
+        const auto room =
+            MEMORY.reserve(result_shape[0] * result_shape[1] *
+                           result_shape[2] * result_shape[3] * sizeof(T));
+        Img result(result_shape[0], result_shape[1], result_shape[2],
+                   result_shape[3]);
+        compute(op, a, b, result);
+        return result;
+    }
+
+    /// Computes a op b into out, resizing it if needed
+    static void binary_into(const kernels::binary_op op,
+                            const arith_operand &a, const arith_operand &b,
+                            Img &out)
+    {
+        const auto result_shape = broadcast_shape(a, b);
+        COW.detach(out);
+        if (result_shape == shape(out)) {
+            compute(op, a, b, out);
+            return;
+        }
+        if (out.is_shared())
+            throw nb::value_error(
+                ("Output image is a shared view of shape " +
+                 shape_to_string(shape(out)) +
+                 ", which can't be resized to the result's shape " +
+                 shape_to_string(result_shape))
+                    .c_str());
+        // Computed aside, as out may be one of the operands
+        auto result = binary(op, a, b);
+        const auto before = owned_bytes(out);
+        result.move_to(out);
+        STATS.image_resized(before, owned_bytes(out));
+    }
+
+    /// Python operator computing img op other (other op img if reflected)
+    static auto binary_operator(const kernels::binary_op op,
+                                const bool reflected)
+    {
+        return [op, reflected](const Img &img,
+                               const nb::handle &other) -> nb::object {
+            check_has_data(img);
+            const auto b = to_operand(other);
+            if (!b)
+                return nb::borrow(Py_NotImplemented);
+            const arith_operand a{&img};
+            return nb::cast(reflected ? binary(op, *b, a) : binary(op, a, *b));
+        };
+    }
+
+    /// Python operator computing img op= other, without broadcasting img
+    static auto inplace_operator(const kernels::binary_op op)
+    {
+        return [op](const nb::handle &self,
+                    const nb::handle &other) -> nb::object {
+            auto &img = nb::cast<Img &>(self);
+            check_has_data(img);
+            const auto b = to_operand(other);
+            if (!b)
+                return nb::borrow(Py_NotImplemented);
+            const arith_operand a{&img};
+            if (broadcast_shape(a, *b) != shape(img))
+                throw nb::value_error(
+                    ("Can't broadcast an operand of shape " +
+                     shape_to_string(operand_shape(*b)) +
+                     " in place into an image of shape " +
+                     shape_to_string(shape(img)))
+                        .c_str());
+            COW.detach(img);
+            compute(op, a, *b, img);
+            return nb::borrow(self);
+        };
+    }
+
+    /// Named method computing img op other, into out if given
+    static auto binary_method(const kernels::binary_op op)
+    {
+        return [op](const Img &img, const nb::handle &other,
+                    const nb::handle &out) -> nb::object {
+            check_has_data(img);
+            const auto b = to_operand(other);
+            if (!b)
+                throw nb::type_error("Operand must be an Image or a number");
+            const arith_operand a{&img};
+            if (out.is_none())
+                return nb::cast(binary(op, a, *b));
+            binary_into(op, a, *b, nb::cast<Img &>(out));
+            return nb::borrow(out);
+        };
+    }
+
+    static constexpr auto binary_method_doc =
+        ". other is an Image or a number, and axes of size 1 are broadcast "
+        "(e.g. a 1-channel mask applies to every channel of an image). The "
+        "result is written to out if given (resized if needed, it may be "
+        "self or other), otherwise to a new image";
+
+    /**
+     * Binds elementwise operators (with their reflected and in-place
+     * variants) and the equivalent named methods taking an out image
+     */
+    static void bind_arithmetic(nb::class_<Img> &cls)
+    {
+        for (const auto &def : OPERATORS) {
+            // Comparisons have no reflected or in-place variants
+            if (def.name) {
+                const string name = def.name;
+                cls.def(("__" + name + "__").c_str(),
+                        binary_operator(def.op, false), "other"_a);
+                if (def.reflected) {
+                    cls.def(("__r" + name + "__").c_str(),
+                            binary_operator(def.op, true), "other"_a);
+                    cls.def(("__i" + name + "__").c_str(),
+                            inplace_operator(def.op), "other"_a);
+                }
+            }
+            cls.def(def.method, binary_method(def.op), "other"_a,
+                    nb::kw_only(), "out"_a = nb::none(),
+                    (def.description + string(binary_method_doc)).c_str());
+        }
+    }
+
+    static constexpr auto eval_expression_doc =
+        "Evaluates a gmic.Expression at every point of the image, into out "
+        "if given (resized to the image's shape if needed, it may be the "
+        "image itself) or into a new image. Vector-valued expressions set "
+        "the first channels at each point";
+    static nb::object eval_expression(const nb::handle &self,
+                                      expression_py &expression,
+                                      const nb::handle &out)
+    {
+        const auto &img = nb::cast<const Img &>(self);
+        check_has_data(img);
+        const auto room =
+            MEMORY.reserve(out.is_none() ? img.size() * sizeof(T) : 0);
+        const auto result =
+            out.is_none() ? nb::cast(Img(img.width(), img.height(),
+                                         img.depth(), img.spectrum(), 0))
+                          : nb::borrow(out);
+        auto &result_img = nb::cast<Img &>(result);
+        COW.detach(result_img);
+        if (!result_img.is_sameXYZC(img)) {
+            if (result_img.is_shared())
+                throw nb::value_error(
+                    "Output image is a shared view of another shape than "
+                    "the image");
+            const auto before = owned_bytes(result_img);
+            result_img.assign(img.width(), img.height(), img.depth(),
+                              img.spectrum(), 0);
+            STATS.image_resized(before, owned_bytes(result_img));
+        }
+        {
+            nb::gil_scoped_release release;
+            const auto lease = THREADS.acquire(0);
+            expression.eval(img, result_img);
+        }
+        return result;
+    }
+
     static int get_buffer(PyObject *exporter, Py_buffer *view,
                           const int flags) noexcept
     {
         LOG_DEBUG();
         const auto handle = nb::handle(exporter);
         try {
+            // Even read-only views must keep seeing the image's own buffer
+            COW.pin(nb::cast<Img &>(handle));
             const auto ndarr = as_ndarray<T>(handle);
             auto ret_val = ndarray_tpbuffer(ndarr, handle, view, flags);
             LOG << ", return code = " << ret_val << endl;
@@ -369,7 +1103,7 @@ class gmic_image_py {
 
         // ReSharper disable CppIdenticalOperandsInBinaryExpression
         auto cls =
-            nb::class_<Img>(m, CLASSNAME, "G'MIC Image", nb::type_slots(slots))
+            nb::class_<Img>(m, CLASSNAME, CLASSDOC, nb::type_slots(slots))
                 .def(DLPACK_INTERFACE, &gmic_image_py::dlpack, nb::kw_only(),
                      "stream"_a = nb::none(), "max_version"_a = nb::none(),
                      "dl_device"_a = nb::none(), "copy"_a = nb::none(),
@@ -381,16 +1115,19 @@ class gmic_image_py {
                 .def(DLPACK_DEVICE_INTERFACE, &gmic_image_py::dlpack_device)
                 .def_prop_ro(ARRAY_INTERFACE, &gmic_image_py::array_interface,
                              nb::rv_policy::reference_internal)
-                .def("as_numpy", &gmic_image_py::as_ndarray<nb::numpy>,
+                .def("as_numpy", &gmic_image_py::as_numpy,
                      nb::rv_policy::reference_internal,
                      "Returns a writable view of the underlying data as a "
                      "Numpy NDArray")
                 .def(
-                    "to_numpy", &gmic_image_py::as_ndarray<nb::numpy>,
-                    nb::rv_policy::copy,
+                    "to_numpy", &gmic_image_py::to_numpy,
                     "Returns a copy of the underlying data as a Numpy NDArray")
                 .def("at", &pixel_at, pixel_at_doc, "x"_a, "y"_a,
                      "z"_a = nb::none())
+                .def("gather", &gather, "coords"_a, gather_doc)
+                .def("scatter", &scatter, "coords"_a, "values"_a,
+                     scatter_doc)
+                .def("sample", &sample, "points"_a, sample_doc)
                 .def_prop_ro(
                     "shape",
                     [](const Img &img) { return tuple_cat(shape<>(img)); },
@@ -414,39 +1151,93 @@ class gmic_image_py {
                              "Total number of values in the image (product of "
                              "all dimensions)")
                 .def("__repr__", &img_to_string)
+                .def(
+                    "__sizeof__",
+                    [](const Img &img) {
+                        return sizeof(Img) + COW.held_bytes(img);
+                    },
+                    "Returns the size of the image and of the buffer it owns "
+                    "or shares with its copies (views of other buffers own "
+                    "none), in bytes")
                 .def("__getitem__", &get, get_pydoc)
-                .def(+nb::self, "Returns a copy of the image")
+                .def("__getitem__", &get_region, "key"_a,
+                     nb::keep_alive<0, 1>(), get_region_doc)
+                .def(
+                    "__getitem__",
+                    [](Img &img, const nb::slice &key) {
+                        return get_region(img, nb::make_tuple(key));
+                    },
+                    "key"_a, nb::keep_alive<0, 1>())
+                .def("__pos__", &gmic_image_py::copy,
+                     "Returns a copy of the image")
                 .def(-nb::self)
-                .def(nb::self == nb::self)
-                .def(nb::self + nb::self)
-                .def(nb::self + int())
-                .def(nb::self + float())
-                .def(nb::self += nb::self, nb::rv_policy::none)
-                .def(nb::self += int(), nb::rv_policy::none)
-                .def(nb::self += float(), nb::rv_policy::none)
-                .def(nb::self - nb::self)
-                .def(nb::self - int())
-                .def(nb::self - float())
-                .def(nb::self -= nb::self, nb::rv_policy::none)
-                .def(nb::self -= int(), nb::rv_policy::none)
-                .def(nb::self -= float(), nb::rv_policy::none)
-                .def(nb::self * int())
-                .def(nb::self * float())
-                .def(nb::self *= int(), nb::rv_policy::none)
-                .def(nb::self *= float(), nb::rv_policy::none)
-                .def(nb::self / int())
-                .def(nb::self / float())
-                .def(nb::self /= int(), nb::rv_policy::none)
-                .def(nb::self /= float(), nb::rv_policy::none);
-
+                .def(nb::self == nb::self);
+        bind_arithmetic(cls);
+
+        cls.def_static("from_bytes", &image_from_bytes, "data"_a,
+                       "format"_a = nb::none(),
+                       "Decodes an encoded image (PNG, JPEG, TIFF, BMP, PNM, "
+                       "PFM or .cimg) held by a bytes-like object, without "
+                       "going through a file. The format is guessed from the "
+                       "data if not given");
+        cls.def("encode", &image_to_bytes, "format"_a,
+                "Encodes the image in the given format (as for from_bytes) "
+                "and returns the resulting bytes. Keyword options: quality "
+                "(JPEG, 0-100), bytes_per_pixel (PNG, PNM), compression "
+                "('none', 'lzw' or 'jpeg' for TIFF, bool for .cimg, implied "
+                "by 'cimgz')");
         cls.def(
             "fill",
-            static_cast<Img &(Img::*)(const char *, bool, bool, CImgList<> *)>(
-                &Img::fill),
+            [](Img &img, const char *expression, const bool repeat_values,
+               const bool allow_formula, CImgList<> *list_images) -> Img & {
+                COW.detach(img);
+                return img.fill(expression, repeat_values, allow_formula,
+                                list_images);
+            },
             "Fills the image with the given value string. Like "
             "assign_dims_valstr with the image's current dimensions",
             "expression"_a, "repeat_values"_a = true, "allow_formula"_a = true,
             "list_images"_a.none() = nullptr, nb::rv_policy::none);
+        cls.def(
+            "fill",
+            [](Img &img, expression_py &expression) -> Img & {
+                check_has_data(img);
+                COW.detach(img);
+                nb::gil_scoped_release release;
+                const auto lease = THREADS.acquire(0);
+                expression.eval(img, img);
+                return img;
+            },
+            "expression"_a, nb::rv_policy::none,
+            "Fills the image with a compiled gmic.Expression, evaluated at "
+            "every point");
+        cls.def("eval", &eval_expression, "expression"_a, nb::kw_only(),
+                "out"_a = nb::none(), eval_expression_doc);
+        cls.def("lazy", &lazy_image_py::of,
+                "Returns a gmic.LazyImage reading the image, on which "
+                "operators are combined and computed in a single pass when "
+                "evaluated, without intermediate images");
+        cls.def("stats", &image_stats, "axis"_a = nb::none(),
+                "Returns the min, max, sum, mean and variance (of the "
+                "population, as in numpy) of the image's values as a dict. "
+                "axis selects the axes reduced: an index, a letter, or a "
+                "string or sequence of them, e.g. 'xyz' for statistics of "
+                "each channel. Statistics are floats if all axes are "
+                "reduced, otherwise float64 arrays of the image's shape, "
+                "with reduced axes of size 1");
+        cls.def("histogram", &image_histogram, "bins"_a,
+                "range"_a = nb::none(),
+                "Returns the number of values in each of bins equal "
+                "intervals of range, a (min, max) tuple defaulting to the "
+                "image's min and max. The last interval includes max, and "
+                "values outside of range aren't counted");
+        cls.def("digest", &image_digest, "algorithm"_a = "xxh3",
+                "Returns a digest of the image's dimensions and values, as 8 "
+                "bytes, with algorithm 'xxh3' or 'xxh64'. Images with the "
+                "same dimensions and bitwise equal values have the same "
+                "digest. Large images are hashed by blocks on several "
+                "threads, and digests aren't cached as images may be "
+                "modified through shared buffers");
         // ReSharper restore CppIdenticalOperandsInBinaryExpression
 
         // Bindings for CImg constructors and assign()'s
@@ -455,7 +1246,8 @@ class gmic_image_py {
             static_cast<new_image_t<TYPES>>(&gmic_image_py::new_image),      \
             assign_signature_doc<TYPES>(doc_buf, doc, "CImg<T>"),            \
             ##__VA_ARGS__)                                                   \
-        .def(funcname, static_cast<assign_t<TYPES>>(&gmic_image_py::assign), \
+        .def(funcname,                                                       \
+             static_cast<assign_t<TYPES>>(&gmic_image_py::tracked_assign),   \
              assign_signature_doc<TYPES>(doc_buf, doc, "CImg<T>::assign"),   \
              nb::rv_policy::none, ##__VA_ARGS__)
         char doc_buf[1024];
@@ -500,6 +1292,7 @@ class gmic_image_py {
                      "Image.from_yxc(array) or img.yxc = array in that case.",
                      ARGS(CTNDArray<>), "array"_a);
 
+        track_lifetimes(cls);
         return cls;
     }
 #undef IMAGE_ASSIGN
@@ -579,6 +1372,7 @@ class yxc_wrapper {
     static NDArray<3, nb::ro> cast_data(const CNDArray<3, From> &ndarray,
                                         const cast_policy cast_pol)
     {
+        STATS.copied(copy_path::IMAGE_TO_YXC, ndarray.size() * sizeof(To));
         return NDArray<3, nb::ro>(
             copy_ndarray<3, From, To>(ndarray, cast_pol));
     }
@@ -617,34 +1411,32 @@ class yxc_wrapper {
         return *bytes;
     }
 
+    /// Supported dtypes, built once (thread-safely) on first use
     static const vector<data_caster> &get_casters()
     {
-        thread_local vector<data_caster> casters;
-        if (casters.empty()) {
-            casters.push_back(data_caster::make_caster<float>());
-            casters.push_back(data_caster::make_caster<double>());
-            casters.push_back(data_caster::make_caster<uint8_t>());
-            casters.push_back(data_caster::make_caster<uint16_t>());
-            casters.push_back(data_caster::make_caster<uint32_t>());
-            casters.push_back(data_caster::make_caster<uint64_t>());
-            casters.push_back(data_caster::make_caster<int8_t>());
-            casters.push_back(data_caster::make_caster<int16_t>());
-            casters.push_back(data_caster::make_caster<int32_t>());
-            casters.push_back(data_caster::make_caster<int64_t>());
-            casters.push_back(data_caster::make_caster<bool>());
-        }
+        static const vector<data_caster> casters{
+            data_caster::make_caster<float>(),
+            data_caster::make_caster<double>(),
+            data_caster::make_caster<uint8_t>(),
+            data_caster::make_caster<uint16_t>(),
+            data_caster::make_caster<uint32_t>(),
+            data_caster::make_caster<uint64_t>(),
+            data_caster::make_caster<int8_t>(),
+            data_caster::make_caster<int16_t>(),
+            data_caster::make_caster<int32_t>(),
+            data_caster::make_caster<int64_t>(),
+            data_caster::make_caster<bool>()};
         return casters;
     }
 
     static const vector<string> &get_casters_strs()
     {
-        thread_local vector<string> typestrings;
-        if (typestrings.empty()) {
-            ranges::transform(get_casters(), back_inserter(typestrings),
+        static const vector<string> typestrings = [] {
+            vector<string> strs;
+            ranges::transform(get_casters(), back_inserter(strs),
                               &data_caster::typestr);
-            if (typestrings.empty())
-                throw runtime_error("");
-        }
+            return strs;
+        }();
         return typestrings;
     }
 
@@ -831,6 +1623,7 @@ class yxc_wrapper {
     {
         const NDArrayAnyD<nb::ro> ndarr = cast_to_ndarray(obj);
         const auto img = new Img();
+        STATS.image_allocated(0);  // Bytes are counted when assigning data
         const auto wrp = make_tmp_wrapper<void>(*img);
         wrp.assign_ndarray(ndarr, false);
         LOG_DEBUG("Created image " << img_to_string(*img) << endl);
@@ -844,6 +1637,7 @@ class yxc_wrapper {
                          << cast_pol << ", dtype: " << caster.typestr
                          << ", samedims: " << samedims << endl);
         const auto arr = to_3d<>(iarr);
+        COW.detach(img);
         const auto same = img.height() == arr.shape(0) &&
                           img.width() == arr.shape(1) &&
                           img.spectrum() == arr.shape(2);
@@ -861,9 +1655,15 @@ class yxc_wrapper {
                     "Can't assign new dims to array with Z set");
             }
             if (!same || img.depth() != 1) {
+                const auto before = owned_bytes(img);
+                const size_t bytes =
+                    arr.shape(0) * arr.shape(1) * arr.shape(2) * sizeof(T);
+                const auto room =
+                    MEMORY.reserve(bytes - min(bytes, before));
                 img.assign(arr.shape(YXC_TO_GMIC[0]),
                            arr.shape(YXC_TO_GMIC[1]), 1,
                            arr.shape(YXC_TO_GMIC[3]));
+                STATS.image_resized(before, owned_bytes(img));
             }
             ez = 0;
         }
@@ -888,6 +1688,7 @@ class yxc_wrapper {
         const auto istrides = arr.stride_ptr();
         const auto ishape = arr.shape_ptr();
         const auto ostrides = strides_yxc<int64_t>(img);
+        STATS.copied(copy_path::YXC_TO_IMAGE, arr.size() * sizeof(T));
 
         copy_ndarray_data<3, Ti, T>(src, istrides, ishape, &img(0, 0, z, 0),
                                     ostrides.data(), cast_pol);
@@ -1001,6 +1802,8 @@ class yxc_wrapper {
         const auto handle = nb::handle(exporter);
         try {
             auto &wrp = nb::cast<yxc_wrapper &>(handle);
+            // The data is converted lazily, once per wrapper
+            nb::ft_object_guard guard(handle);
             const auto &ndarr = wrp.get_data();
             auto ret_val = ndarray_tpbuffer(ndarr, handle, view, flags);
             LOG << ", return code = " << ret_val << endl;
@@ -1076,16 +1879,18 @@ class yxc_wrapper {
                         const nb::handle &obj) {
                          wrp.with(args).assign(obj, true);
                      })
-                .def(DLPACK_INTERFACE, &yxc_wrapper::to_ndarray<>)
+                .def(DLPACK_INTERFACE, &yxc_wrapper::to_ndarray<>,
+                     nb::lock_self())
                 .def(DLPACK_DEVICE_INTERFACE, &yxc_wrapper::dlpack_device)
                 .def_prop_ro(ARRAY_INTERFACE, &yxc_wrapper::array_interface,
-                             nb::rv_policy::reference)
+                             nb::rv_policy::reference, nb::lock_self())
                 .def("__repr__", &yxc_wrapper::str)
                 .def("to_numpy", &yxc_wrapper::to_ndarray<nb::numpy>,
+                     nb::lock_self(),
                      "Returns a copy of the underlying data as a Numpy "
                      "NDArray")
                 .def(
-                    "tobytes", &yxc_wrapper::get_bytes,
+                    "tobytes", &yxc_wrapper::get_bytes, nb::lock_self(),
                     "Returns the image data converted to the wrapper dtype as "
                     "a bytes object")
                 .def_prop_ro(
@@ -1,7 +1,16 @@
 #ifndef GMIC_LIST_PY_HPP
 #define GMIC_LIST_PY_HPP
 
+#include "codecs.hpp"
+#include "command_library.hpp"
+#include "cow.hpp"
 #include "gmicpy.hpp"
+#include "memory.hpp"
+#include "prefetcher.hpp"
+#include "reductions.hpp"
+#include "run_cache.hpp"
+#include "stream.hpp"
+#include "utils.hpp"
 
 namespace gmicpy {
 namespace nb = nanobind;
@@ -9,43 +18,261 @@ using namespace nanobind::literals;
 using namespace std;
 using namespace cimg_library;
 
+/**
+ * Storage of an ImageList: each image lives in a heap allocation of its own,
+ * shared with the Python objects of the items returned for it. Inserts and
+ * removals move pointers rather than images, so that items keep referring to
+ * the same image whatever happens to the list, and images removed from the
+ * list live on while Python holds them. Mirrors the parts of CImgList's
+ * interface that lists use.
+ */
 template <class T>
-class gmic_list_base {
-   protected:
-    CImgList<T> list{};
+class image_slots {
+    using Img = CImg<T>;
 
-    template <class... Args>
-    explicit gmic_list_base(Args... args) : list(args...)
+    /**
+     * Deletes an image, accounting for it if it outlived its list, whose
+     * own accounting stops when images leave it
+     */
+    struct deleter {
+        bool orphaned = false;
+
+        void operator()(Img *img) const
+        {
+            if (orphaned) {
+                STATS.image_freed(owned_bytes(*img));
+                COW.release(*img);
+            }
+            delete img;
+        }
+    };
+
+    vector<shared_ptr<Img>> items;
+
+    static shared_ptr<Img> make() { return {new Img(), deleter{}}; }
+
+    /// Drops the list's reference to an image leaving it
+    static void drop(shared_ptr<Img> &item)
     {
-        LOG_DEBUG("Data is at: " << list._data << endl);
+        if (item.use_count() > 1) {
+            // Views of a from_batch array mustn't outlive the list holding it
+            if (item->is_shared() && !COW.is_member(*item)) {
+                Img copy(*item, false);
+                STATS.copied(copy_path::LIST_ITEM, owned_bytes(copy));
+                STATS.image_resized(0, owned_bytes(copy));
+                copy.swap(*item);
+            }
+            get_deleter<deleter>(item)->orphaned = true;
+        }
+        else {
+            STATS.image_freed(owned_bytes(*item));
+            COW.release(*item);
+        }
+        item.reset();
     }
 
+   public:
+    /// Iterator over the images themselves, rather than their pointers
+    class iterator {
+        typename vector<shared_ptr<Img>>::const_iterator it;
+
+       public:
+        using iterator_concept = forward_iterator_tag;
+        using value_type = Img;
+        using difference_type = ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(decltype(it) it) : it(it) {}
+
+        Img &operator*() const { return **it; }
+
+        iterator &operator++()
+        {
+            ++it;
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            auto old = *this;
+            ++it;
+            return old;
+        }
+
+        bool operator==(const iterator &) const = default;
+    };
+
+    image_slots() = default;
+    image_slots(const image_slots &) = delete;
+    image_slots &operator=(const image_slots &) = delete;
+    ~image_slots() { assign(); }
+
+    [[nodiscard]] unsigned int size() const
+    {
+        return static_cast<unsigned int>(items.size());
+    }
+
+    [[nodiscard]] size_t capacity() const { return items.capacity(); }
+
+    Img &operator()(const unsigned int i) const { return *items[i]; }
+
+    /// Shared pointer to the i-th image, as handed out to Python
+    [[nodiscard]] const shared_ptr<Img> &ptr(const unsigned int i) const
+    {
+        return items[i];
+    }
+
+    [[nodiscard]] iterator begin() const { return iterator(items.begin()); }
+    [[nodiscard]] iterator end() const { return iterator(items.end()); }
+
+    /// Inserts n empty images at pos
+    void insert(const unsigned int n, const unsigned int pos)
+    {
+        const auto first = items.insert(items.begin() + pos, n, nullptr);
+        generate_n(first, n, make);
+    }
+
+    void remove(const unsigned int pos) { remove(pos, pos); }
+
+    /// Removes the images from pos0 to pos1 included
+    void remove(const unsigned int pos0, const unsigned int pos1)
+    {
+        for (auto i = pos0; i <= pos1; i++)
+            drop(items[i]);
+        items.erase(items.begin() + pos0, items.begin() + pos1 + 1);
+    }
+
+    void assign()
+    {
+        if (!items.empty())
+            remove(0, size() - 1);
+    }
+
+    /// Replaces the images by n empty ones
+    void assign(const unsigned int n)
+    {
+        assign();
+        insert(n, 0);
+    }
+
+    void reverse() { ranges::reverse(items); }
+
+    /**
+     * Shared views of the images, for functions taking a CImgList that
+     * only read it
+     */
+    [[nodiscard]] CImgList<T> views() const
+    {
+        CImgList<T> out(size());
+        for (unsigned int i = 0; i < size(); i++)
+            out(i).assign(items[i]->data(), items[i]->_width,
+                          items[i]->_height, items[i]->_depth,
+                          items[i]->_spectrum, true);
+        return out;
+    }
+
+    /// Moves the images out into images, leaving their slots empty
+    void take(CImgList<T> &images)
+    {
+        images.assign(size());
+        for (unsigned int i = 0; i < size(); i++)
+            images(i).swap(*items[i]);
+    }
+
+    /**
+     * Moves images' images into the slots in order, adding or removing
+     * slots so that there is one per image, and leaves images empty
+     */
+    void put(CImgList<T> &images)
+    {
+        if (images.size() < size())
+            remove(images.size(), size() - 1);
+        else if (images.size() > size())
+            insert(images.size() - size(), size());
+        for (unsigned int i = 0; i < size(); i++)
+            items[i]->swap(images(i));
+        images.assign();
+    }
+};
+
+template <class T>
+class gmic_list_base {
+   protected:
+    /// Array whose buffer is shared by images created through from_batch
+    nb::ndarray<T, nb::device::cpu> batch{};
+    /// Declared after batch, so that it is destroyed first
+    image_slots<T> list{};
+
+    gmic_list_base() = default;
     virtual ~gmic_list_base() = default;
 
    public:
-    static constexpr const char *CLASSINFO[2] = {"ImageList",
-                                                 "List of G'MIC images"};
-    using Item = CImg<T> &;
+    static constexpr const char *CLASSINFO[2] = {
+        "ImageList",
+        "List of G'MIC images. Its methods lock the list, so that it may be "
+        "shared between threads, except for those that release the GIL "
+        "(Gmic.run, to_batch, stats, digest and encode), during which other "
+        "threads must not modify it. Items are returned as references to "
+        "the list's images, which modifying modifies the list. They stay "
+        "valid whatever happens to the list: inserts and removals don't "
+        "move images, and removed images live on, out of the list, while "
+        "they are referenced"};
+    static constexpr bool IS_IMAGE = true;
+    using Item = shared_ptr<CImg<T>>;
+
+    static Item item_at(const image_slots<T> &list, const unsigned int pos)
+    {
+        return list.ptr(pos);
+    }
 
-    [[nodiscard]] Item get(unsigned int i)
+    /// Whether obj is the image item itself
+    static bool is(const CImg<T> &item, const nb::handle &obj)
     {
-        if (i >= list.size())
-            throw out_of_range("Out of range or gmic_list_py object");
-        return list(i);
+        return nb::isinstance<CImg<T>>(obj) &&
+               &nb::cast<const CImg<T> &>(obj) == &item;
     }
 
-    void set(unsigned int i, const CImg<T> &item)
+    /**
+     * Makes item out of obj, by copying it or, if steal is set and obj is
+     * an Image, by moving its buffer (which leaves obj empty). Images with
+     * exported views are copied, as moving would leave the views dangling.
+     */
+    static void convert(CImg<T> &item, const nb::handle &obj,
+                        const bool steal)
     {
-        if (i >= list.size())
-            throw out_of_range("Out of range or gmic_list_py object");
-        list(i).assign(item);
+        if (nb::isinstance<CImg<T>>(obj)) {
+            auto &src = nb::cast<CImg<T> &>(obj);
+            if (steal && !COW.is_pinned(src)) {
+                STATS.image_resized(owned_bytes(src), 0);
+                COW.move(src, item);
+                return;
+            }
+            COW.copy(src).swap(item);
+        }
+        else if (!nb::try_cast(obj, item, true)) {
+            throw nb::type_error(
+                "Object isn't and cannot be made into a G'MIC Image");
+        }
+        STATS.copied(copy_path::LIST_ITEM, owned_bytes(item));
     }
 
-    void move_set(unsigned int i, CImg<T> &&item)
+    static bool equals(const CImg<T> &item, const nb::handle &obj)
     {
-        if (i >= list.size())
-            throw out_of_range("Out of range or gmic_list_py object");
-        item.move_to(list(i));
+        return nb::isinstance<CImg<T>>(obj) &&
+               item == nb::cast<const CImg<T> &>(obj);
+    }
+
+    /// Moves item into dst, keeping copy-on-write images shared
+    static void place(CImg<T> &item, CImg<T> &dst) { COW.move(item, dst); }
+
+    /// Releases a staged item that won't enter the list
+    static void release(CImg<T> &item) { COW.release(item); }
+
+    /// Bytes of the list's own storage, excluding the images' buffers
+    static size_t storage_bytes(const image_slots<T> &list)
+    {
+        return list.capacity() * sizeof(shared_ptr<CImg<T>>) +
+               list.size() * sizeof(CImg<T>);
     }
 };
 
@@ -65,71 +292,570 @@ class gmic_list_base<char> {
     using Item = string;
     static constexpr const char *CLASSINFO[2] = {"StringList",
                                                  "List of strings"};
+    static constexpr bool IS_IMAGE = false;
+
+    static Item item_of(const CImg<char> &str)
+    {
+        if (str.is_empty())
+            return {};
+        return {str.data(), length(str)};
+    }
+
+    static Item item_at(const CImgList<char> &list, const unsigned int pos)
+    {
+        return item_of(list(pos));
+    }
+
+    static bool is(const CImg<char> &, const nb::handle &) { return false; }
+
+    /// Length of a string item, up to its terminating null character
+    static size_t length(const CImg<char> &str)
+    {
+        return str.is_empty() ? 0 : strnlen(str.data(), str.size());
+    }
+
+    static nb::str to_str(const CImg<char> &str)
+    {
+        return {str.is_empty() ? "" : str.data(), length(str)};
+    }
 
-    [[nodiscard]] Item get(const unsigned int i) const
+    /// Copies a Python str's UTF-8 data straight into item, null-terminated
+    static void convert(CImg<char> &item, const nb::handle &obj, bool)
     {
-        if (i >= list.size())
-            throw out_of_range("Out of range or gmic_list_py object");
-        return {list(i)};
+        Py_ssize_t size;
+        const char *str = PyUnicode_AsUTF8AndSize(obj.ptr(), &size);
+        if (!str)
+            nb::raise_python_error();
+        item.assign(str, static_cast<unsigned int>(size) + 1);
     }
 
-    void set(const unsigned int i, const Item &item)
+    static bool equals(const CImg<char> &item, const nb::handle &obj)
     {
-        if (i >= list.size())
-            throw out_of_range("Out of range or gmic_list_py object");
-        list(i).assign(CImg<char>::string(item.c_str()));
+        return nb::isinstance<nb::str>(obj) &&
+               item_of(item) == nb::cast<string>(obj);
     }
 
-    void move_set(unsigned int i, Item &&item) { set(i, item); }
+    static void place(CImg<char> &item, CImg<char> &dst)
+    {
+        item.move_to(dst);
+    }
+
+    static void release(CImg<char> &) {}
+
+    static size_t storage_bytes(const CImgList<char> &list)
+    {
+        return list._allocated_width * sizeof(CImg<char>);
+    }
+};
+
+/// Iterator over images decoded from files by background threads
+class image_file_iterator {
+    using Img = CImg<gmic_pixel_type>;
+
+    const vector<filesystem::path> paths;
+    unique_ptr<ordered_prefetcher<Img>> prefetcher;
+
+   public:
+    constexpr static auto CLASSNAME = "ImageFileIterator";
+
+    image_file_iterator(const vector<filesystem::path> &paths,
+                        const size_t prefetch, const unsigned int threads)
+        : paths(paths),
+          prefetcher(make_unique<ordered_prefetcher<Img>>(
+              paths.size(),
+              [this](const size_t i) {
+                  Img img;
+                  img.load(this->paths[i].string().c_str());
+                  return img;
+              },
+              prefetch, threads))
+    {
+    }
+
+    ~image_file_iterator()
+    {
+        // Waits for in-flight decodes, which don't need the GIL
+        nb::gil_scoped_release release;
+        prefetcher.reset();
+    }
+
+    Img next()
+    {
+        optional<Img> img;
+        {
+            nb::gil_scoped_release release;
+            img = prefetcher->next();
+        }
+        if (!img)
+            throw nb::stop_iteration();
+        return std::move(*img);
+    }
+
+    static void bind(nb::module_ &m)
+    {
+        LOG_DEBUG("Binding gmic." << CLASSNAME << " class" << endl);
+        nb::class_<image_file_iterator>(
+            m, CLASSNAME,
+            "Iterator over images decoded from files by background threads, "
+            "in order")
+            .def("__iter__", [](nb::object self) { return self; })
+            .def("__next__", &image_file_iterator::next, nb::lock_self())
+            .def("__len__", [](const image_file_iterator &it) {
+                return it.paths.size();
+            });
+    }
 };
 
 template <class T = gmic_pixel_type>
 class gmic_list_py : public gmic_list_base<T> {
     using Base = gmic_list_base<T>;
     using Item = typename Base::Item;
-    using RawItem = remove_reference_t<Item>;
+
+    /// Accounts for an image leaving the list
+    static void count_dropped(const CImg<T> &img)
+    {
+        if constexpr (Base::IS_IMAGE)
+            STATS.image_freed(owned_bytes(img));
+    }
+
+    /// Drops staged items that won't enter the list
+    static void drop(CImgList<T> &staged)
+    {
+        for (auto &item : staged) {
+            count_dropped(item);
+            Base::release(item);
+        }
+    }
+
+    /// Accounts for an image entering the list
+    static void count_added(const CImg<T> &img)
+    {
+        if constexpr (Base::IS_IMAGE)
+            STATS.image_allocated(owned_bytes(img));
+    }
+
+    /// Converts a Python index into a position, wrapping negative values
+    [[nodiscard]] unsigned int position(long i)
+    {
+        const auto n = static_cast<long>(size());
+        if (i < 0)
+            i += n;
+        if (i < 0 || i >= n)
+            throw out_of_range(string(Base::CLASSINFO[0]) +
+                               " index out of range");
+        return static_cast<unsigned int>(i);
+    }
+
+    /// Converts every item of a sequence, without touching the list itself
+    [[nodiscard]] static CImgList<T> stage(const nb::handle &seq,
+                                           const bool steal)
+    {
+        CImgList<T> staged;
+        try {
+            for (const auto &obj : seq) {
+                staged.insert(1);
+                Base::convert(staged.back(), obj, steal);
+                count_added(staged.back());
+            }
+        }
+        catch (...) {
+            drop(staged);
+            throw;
+        }
+        return staged;
+    }
+
+    /// Position of the k-th item of a computed slice
+    [[nodiscard]] static unsigned int at(const Py_ssize_t start,
+                                         const Py_ssize_t step,
+                                         const size_t k)
+    {
+        return static_cast<unsigned int>(start +
+                                         static_cast<Py_ssize_t>(k) * step);
+    }
+
+    /// Moves staged items into the list, at the given position
+    void unstage(CImgList<T> &staged, const unsigned int pos)
+    {
+        list().insert(staged.size(), pos);
+        for (unsigned int k = 0; k < staged.size(); k++)
+            Base::place(staged(k), list()(pos + k));
+        staged.assign();
+    }
 
    public:
+    static constexpr auto steal_doc =
+        "If steal is set, Images are moved into the list rather than copied, "
+        "leaving them empty, unless arrays or views were exported from them";
+
     gmic_list_py() : Base() {}
 
-    explicit gmic_list_py(const nb::sequence &seq) : Base(len(seq))
+    explicit gmic_list_py(const nb::sequence &seq) : Base()
     {
-        const size_t N = size();
+        const size_t N = len(seq);
         size_t i = 0;
-        vector<RawItem> imgs(N, RawItem{});
-        // First check that the sequence contains only images or compatible
-        for (const auto &img : seq) {
-            if (i >= size())
+        for (const auto &obj : seq) {
+            if (i++ >= N)
                 throw invalid_argument(
                     "Sequence contains more items than expected");
-            if (!nb::try_cast(img, imgs[i++], true))
-                throw nb::type_error(
-                    "Sequence contains object(s) that isn't and cannot be "
-                    "made into a G'MIC Image");
+            insert(static_cast<long>(size()), obj, false);
         }
         if (i < N)
             throw invalid_argument(
                 "Sequence contains less items than expected");
+    }
 
-        i = 0;
-        for (auto it = make_move_iterator(imgs.begin());
-             it != make_move_iterator(imgs.end()); ++it) {
-            Base::move_set(i++, *it);
+    ~gmic_list_py() override { LOG_DEBUG("Size: " << size() << endl); }
+
+    auto &list() { return Base::list; }
+
+    Item get(const long i) { return Base::item_at(list(), position(i)); }
+
+    auto operator[](unsigned int i) { return get(i); }
+
+    /**
+     * Maps a batch layout (e.g. "nczyx") onto the xyzc axes: returns, for
+     * each of them, the corresponding array dimension or -1 if it is absent
+     */
+    static array<int, 4> parse_layout(const string &layout, const size_t ndim)
+    {
+        if (layout.size() != ndim || layout[0] != 'n')
+            throw nb::value_error(
+                ("Invalid layout '" + layout +
+                 "': must start with 'n' and have one letter per dimension")
+                    .c_str());
+        array axes{-1, -1, -1, -1};
+        for (size_t i = 1; i < ndim; i++) {
+            const auto axis = string_view("xyzc").find(layout[i]);
+            if (axis == string_view::npos || axes[axis] != -1)
+                throw nb::value_error(
+                    ("Invalid layout '" + layout +
+                     "': letters must be unique and among 'xyzc'")
+                        .c_str());
+            axes[axis] = static_cast<int>(i);
         }
+        return axes;
     }
 
-    ~gmic_list_py() override
+    static constexpr auto from_batch_doc =
+        "Creates a list from a batch array whose first dimension indexes the "
+        "images. The layout names its dimensions, and defaults to 'nx', "
+        "'nyx', 'nyxc' or 'nczyx' for 2D to 5D arrays. If shared is set and "
+        "each image is contiguous in G'MIC's planar order (like a "
+        "C-contiguous 'nczyx' array), the images are views into the array's "
+        "buffer instead of copies: writes go through to the array, and their "
+        "size cannot change in place";
+
+    static gmic_list_py *from_batch(const nb::ndarray<T, nb::device::cpu> &arr,
+                                    const optional<string> &layout,
+                                    const bool shared)
     {
-        LOG_DEBUG("Size: " << size() << ", data at: " << list()._data << endl);
+        const auto ndim = arr.ndim();
+        if (ndim < 2 || ndim > 5)
+            throw nb::value_error(
+                "Invalid ndarray dimensions for batch (should be "
+                "2 <= N <= 5)");
+        static constexpr const char *DEFAULT_LAYOUTS[] = {
+            "nx", "nyx", "nyxc", "nczyx"};
+        const auto axes =
+            parse_layout(layout ? *layout : DEFAULT_LAYOUTS[ndim - 2], ndim);
+        array<size_t, 4> dim{1, 1, 1, 1};
+        array<int64_t, 4> strides{0, 0, 0, 0};
+        for (size_t a = 0; a < 4; a++) {
+            if (axes[a] < 0)
+                continue;
+            dim[a] = arr.shape(axes[a]);
+            strides[a] = arr.stride(axes[a]);
+        }
+
+        // Images are planar views of the buffer if each axis' stride is the
+        // product of the previous ones' sizes (singleton axes don't matter)
+        bool planar = true;
+        int64_t expected = 1;
+        for (size_t a = 0; a < 4; a++) {
+            if (dim[a] > 1 && strides[a] != expected)
+                planar = false;
+            expected *= static_cast<int64_t>(dim[a]);
+        }
+
+        const auto room = MEMORY.reserve(
+            planar && shared ? 0
+                             : arr.shape(0) * dim[0] * dim[1] * dim[2] *
+                                   dim[3] * sizeof(T));
+        auto out = make_unique<gmic_list_py>();
+        out->list().assign(static_cast<unsigned int>(arr.shape(0)));
+        for (unsigned int n = 0; n < out->size(); n++) {
+            auto &img = out->list()(n);
+            const T *src = arr.data() + n * arr.stride(0);
+            if (planar && shared) {
+                img.assign(src, dim[0], dim[1], dim[2], dim[3], true);
+            }
+            else if (planar) {
+                img.assign(src, dim[0], dim[1], dim[2], dim[3]);
+            }
+            else {
+                img.assign(dim[0], dim[1], dim[2], dim[3]);
+                cimg_forXYZC(img, x, y, z, c)
+                {
+                    img(x, y, z, c) =
+                        src[x * strides[0] + y * strides[1] + z * strides[2] +
+                            c * strides[3]];
+                }
+            }
+            if (!img.is_shared())
+                STATS.copied(copy_path::NDARRAY_TO_IMAGE, owned_bytes(img));
+            count_added(img);
+        }
+        if (planar && shared)
+            out->batch = arr;
+        return out.release();
+    }
+
+    static gmic_list_py *from_list(const nb::list &items)
+    {
+        auto out = make_unique<gmic_list_py>();
+        const auto N = static_cast<unsigned int>(nb::len(items));
+        out->list().assign(N);
+        for (unsigned int i = 0; i < N; i++)
+            Base::convert(out->list()(i), items[i], false);
+        return out.release();
+    }
+
+    nb::list to_list()
+    {
+        auto out = nb::steal<nb::list>(PyList_New(size()));
+        for (unsigned int i = 0; i < size(); i++)
+            PyList_SetItem(out.ptr(), i,
+                           Base::to_str(list()(i)).release().ptr());
+        return out;
     }
 
-    CImgList<T> &list() { return Base::list; }
+    static gmic_list_py *from_bytes(const byte_array &data,
+                                    const optional<string> &format)
+    {
+        auto out = make_unique<gmic_list_py>();
+        CImgList<T> images;
+        const auto room = list_from_bytes(images, data, format);
+        out->list().put(images);
+        for (const auto &img : out->list())
+            count_added(img);
+        return out.release();
+    }
 
-    auto operator[](unsigned int i) { return this->get(i); }
-    auto operator[](unsigned int i) const { return this->get(i); }
+    static gmic_list_py *decode_many(const nb::handle &sources,
+                                     const optional<string> &format,
+                                     const unsigned int threads)
+    {
+        auto out = make_unique<gmic_list_py>();
+        CImgList<T> images;
+        const auto room =
+            gmicpy::decode_many(images, sources, format, threads);
+        out->list().put(images);
+        for (const auto &img : out->list())
+            count_added(img);
+        return out.release();
+    }
+
+    static constexpr auto to_batch_doc =
+        "Copies all images, which must have the same dimensions, into a "
+        "single new C-contiguous Numpy array with the given layout. Axes "
+        "missing from the layout must have a size of 1";
+
+    nb::ndarray<nb::numpy, T> to_batch(const string &layout)
+    {
+        const auto ndim = layout.size();
+        const auto axes = parse_layout(layout, ndim);
+        const auto N = size();
+        const auto &first = N ? list()(0) : CImg<T>::empty();
+        for (const auto &img : list()) {
+            if (!img.is_sameXYZC(first))
+                throw nb::value_error(
+                    "All images must have the same dimensions");
+        }
+        const array<size_t, 4> dim{
+            static_cast<size_t>(first.width()),
+            static_cast<size_t>(first.height()),
+            static_cast<size_t>(first.depth()),
+            static_cast<size_t>(first.spectrum())};
+
+        vector<size_t> shape(ndim);
+        shape[0] = N;
+        for (size_t a = 0; a < 4; a++) {
+            if (axes[a] >= 0)
+                shape[axes[a]] = dim[a];
+            else if (dim[a] != 1)
+                throw nb::value_error(
+                    ("Images have a size of " + to_string(dim[a]) +
+                     " on axis '" + string(1, "xyzc"[a]) +
+                     "', which is missing from the layout")
+                        .c_str());
+        }
+        // C-contiguous strides, then mapped back onto the xyzc axes
+        vector<size_t> cstrides(ndim, 1);
+        for (size_t i = ndim - 1; i > 0; i--)
+            cstrides[i - 1] = cstrides[i] * shape[i];
+        array<size_t, 4> strides{0, 0, 0, 0};
+        for (size_t a = 0; a < 4; a++)
+            if (axes[a] >= 0)
+                strides[a] = cstrides[axes[a]];
+
+        const size_t total = N * first.size();
+        auto *data = new T[total];
+        nb::capsule owner(data, [](void *p) noexcept {
+            delete[] static_cast<T *>(p);
+        });
+        const bool planar = layout == "nczyx" || layout == "ncyx";
+        for (unsigned int n = 0; n < N; n++) {
+            const auto &img = list()(n);
+            T *dst = data + n * cstrides[0];
+            if (planar) {
+                copy_n(img.data(), img.size(), dst);
+                continue;
+            }
+            cimg_forXYZC(img, x, y, z, c)
+            {
+                dst[x * strides[0] + y * strides[1] + z * strides[2] +
+                    c * strides[3]] = img(x, y, z, c);
+            }
+        }
+        STATS.copied(copy_path::IMAGE_TO_NDARRAY, total * sizeof(T));
+        return nb::ndarray<nb::numpy, T>(data, ndim, shape.data(), owner);
+    }
+
+    gmic_list_py *get_slice(const nb::slice &slice)
+    {
+        const auto [start, stop, step, count] = slice.compute(size());
+        auto out = make_unique<gmic_list_py>();
+        out->list().assign(static_cast<unsigned int>(count));
+        for (size_t k = 0; k < count; ++k) {
+            auto &item = out->list()(k);
+            if constexpr (Base::IS_IMAGE) {
+                COW.copy(list()(at(start, step, k))).swap(item);
+                STATS.copied(copy_path::LIST_ITEM, owned_bytes(item));
+            }
+            else {
+                item.assign(list()(at(start, step, k)));
+            }
+            count_added(item);
+        }
+        return out.release();
+    }
+
+    void set(const long i, const nb::handle &obj)
+    {
+        auto &dst = list()(position(i));
+        if (Base::is(dst, obj))
+            return;
+        CImg<T> item;
+        Base::convert(item, obj, false);
+        count_dropped(dst);
+        count_added(item);
+        Base::place(item, dst);
+    }
+
+    void set_slice(const nb::slice &slice, const nb::handle &seq)
+    {
+        const auto [start, stop, step, count] = slice.compute(size());
+        auto staged = stage(seq, false);
+        if (step == 1) {
+            del_slice(slice);
+            unstage(staged, static_cast<unsigned int>(start));
+            return;
+        }
+        if (staged.size() != count) {
+            drop(staged);
+            throw nb::value_error(
+                ("attempt to assign sequence of size " +
+                 to_string(staged.size()) + " to extended slice of size " +
+                 to_string(count))
+                    .c_str());
+        }
+        for (size_t k = 0; k < count; ++k) {
+            auto &dst = list()(at(start, step, k));
+            count_dropped(dst);
+            Base::place(staged(k), dst);
+        }
+    }
+
+    void del(const long i) { list().remove(position(i)); }
+
+    void del_slice(const nb::slice &slice)
+    {
+        const auto [start, stop, step, count] = slice.compute(size());
+        if (count == 0)
+            return;
+        if (step == 1) {
+            list().remove(at(start, 1, 0), at(start, 1, count - 1));
+            return;
+        }
+        // Remove the highest positions first, so that the others stay valid
+        for (size_t k = 0; k < count; ++k)
+            list().remove(at(start, step, step < 0 ? k : count - 1 - k));
+    }
+
+    void insert(long i, const nb::handle &obj, const bool steal)
+    {
+        const auto n = static_cast<long>(size());
+        if (i < 0)
+            i = max(i + n, 0L);
+        i = min(i, n);
+        CImg<T> item;
+        Base::convert(item, obj, steal);
+        count_added(item);
+        list().insert(1, static_cast<unsigned int>(i));
+        Base::place(item, list()(static_cast<unsigned int>(i)));
+    }
+
+    void append(const nb::handle &obj, const bool steal)
+    {
+        insert(static_cast<long>(size()), obj, steal);
+    }
+
+    gmic_list_py &extend(const nb::handle &seq, const bool steal)
+    {
+        auto staged = stage(seq, steal);
+        unstage(staged, list().size());
+        return *this;
+    }
+
+    Item pop(const long i)
+    {
+        const auto pos = position(i);
+        auto item = Base::item_at(list(), pos);
+        list().remove(pos);
+        return item;
+    }
+
+    void clear() { list().assign(); }
+
+    void reverse() { list().reverse(); }
+
+    [[nodiscard]] long index(const nb::handle &obj)
+    {
+        for (unsigned int i = 0; i < size(); ++i)
+            if (Base::equals(list()(i), obj))
+                return i;
+        throw nb::value_error("Item is not in list");
+    }
+
+    [[nodiscard]] size_t count(const nb::handle &obj)
+    {
+        return ranges::count_if(list(), [&](const CImg<T> &item) {
+            return Base::equals(item, obj);
+        });
+    }
+
+    [[nodiscard]] bool contains(const nb::handle &obj)
+    {
+        return ranges::any_of(list(), [&](const CImg<T> &item) {
+            return Base::equals(item, obj);
+        });
+    }
+
+    void remove(const nb::handle &obj) { del(index(obj)); }
 
     // TODO fix deprecatied std::iterator
-    class iterator : std::iterator<std::forward_iterator_tag, RawItem> {
+    class iterator : std::iterator<std::forward_iterator_tag, Item> {
         gmic_list_py &list;
         unsigned int iter = 0;
 
@@ -148,7 +874,12 @@ class gmic_list_py : public gmic_list_base<T> {
         bool operator==(iterator other) const { return iter == other.iter; }
         bool operator!=(iterator other) const { return !operator==(other); }
 
-        auto operator*() const { return list[iter]; }
+        auto operator*() const
+        {
+            // Python iterators step outside of the list's (locked) methods
+            nb::ft_object_guard guard(nb::find(&list));
+            return list[iter];
+        }
     };
 
     size_t size() { return Base::list._width; }
@@ -172,12 +903,15 @@ class gmic_list_py : public gmic_list_base<T> {
         if constexpr (with_list) {
             out << " [";
             bool first = true;
-            for (auto item : *this) {
+            for (auto &item : list()) {
                 if (first)
                     first = false;
                 else
                     out << ", ";
-                out << item;
+                if constexpr (Base::IS_IMAGE)
+                    out << item;
+                else
+                    out << Base::item_of(item);
             }
             out << ']';
         }
@@ -190,17 +924,136 @@ class gmic_list_py : public gmic_list_base<T> {
     {
         LOG_DEBUG("Binding gmic." << gmic_list_base<T>::CLASSINFO[0]
                                   << " class" << endl);
-        nb::class_<gmic_list_py>(m, gmic_list_base<T>::CLASSINFO[0],
-                                 gmic_list_base<T>::CLASSINFO[1])
-            .def(nb::init())
-            .def(nb::init_implicit<nb::sequence>())
-            .def("__iter__", &gmic_list_py::iter)
-            .def("__len__", &gmic_list_py::size)
-            .def("__str__", &gmic_list_py::str<false>)
-            .def("__repr__", &gmic_list_py::str<true>)
-            .def("__getitem__", &gmic_list_py::get, "i"_a,
-                 nb::rv_policy::reference_internal)
-            .def("__setitem__", &gmic_list_py::set, "i"_a, "v"_a);
+        auto cls =
+            nb::class_<gmic_list_py>(m, gmic_list_base<T>::CLASSINFO[0],
+                                     gmic_list_base<T>::CLASSINFO[1])
+                .def(nb::init())
+                .def(nb::init_implicit<nb::sequence>())
+                .def("__iter__", &gmic_list_py::iter, nb::lock_self())
+                .def("__len__", &gmic_list_py::size, nb::lock_self())
+                .def(
+                    "__sizeof__",
+                    [](gmic_list_py &self) {
+                        size_t bytes = sizeof(gmic_list_py) +
+                                       Base::storage_bytes(self.list());
+                        for (const auto &item : self.list()) {
+                            if constexpr (Base::IS_IMAGE)
+                                bytes += COW.held_bytes(item);
+                            else
+                                bytes += owned_bytes(item);
+                        }
+                        return bytes;
+                    },
+                    nb::lock_self(),
+                    "Returns the size of the list and of the buffers its "
+                    "items own or share with their copies, in bytes")
+                .def("__str__", &gmic_list_py::str<false>, nb::lock_self())
+                .def("__repr__", &gmic_list_py::str<true>, nb::lock_self())
+                .def("__getitem__", &gmic_list_py::get, nb::lock_self(),
+                     "i"_a)
+                .def("__getitem__", &gmic_list_py::get_slice,
+                     nb::lock_self(), "slice"_a,
+                     nb::rv_policy::take_ownership,
+                     "Returns a new list with copies of the sliced items")
+                .def("__setitem__", &gmic_list_py::set, nb::lock_self(),
+                     "i"_a, "v"_a)
+                .def("__setitem__", &gmic_list_py::set_slice,
+                     nb::lock_self(), "slice"_a, "v"_a)
+                .def("__delitem__", &gmic_list_py::del, nb::lock_self(),
+                     "i"_a)
+                .def("__delitem__", &gmic_list_py::del_slice,
+                     nb::lock_self(), "slice"_a)
+                .def("__contains__", &gmic_list_py::contains,
+                     nb::lock_self(), "item"_a)
+                .def("__iadd__", &gmic_list_py::extend, nb::lock_self(),
+                     "items"_a, "steal"_a = false, nb::rv_policy::none)
+                .def("insert", &gmic_list_py::insert, nb::lock_self(),
+                     "i"_a, "item"_a, nb::kw_only(), "steal"_a = false,
+                     steal_doc)
+                .def("append", &gmic_list_py::append, nb::lock_self(),
+                     "item"_a, nb::kw_only(), "steal"_a = false, steal_doc)
+                .def("extend", &gmic_list_py::extend, nb::lock_self(),
+                     "items"_a, nb::kw_only(), "steal"_a = false,
+                     nb::rv_policy::none, steal_doc)
+                .def("pop", &gmic_list_py::pop, nb::lock_self(), "i"_a = -1,
+                     "Removes and returns the item at the given position")
+                .def("clear", &gmic_list_py::clear, nb::lock_self())
+                .def("reverse", &gmic_list_py::reverse, nb::lock_self())
+                .def("index", &gmic_list_py::index, nb::lock_self(),
+                     "item"_a)
+                .def("count", &gmic_list_py::count, nb::lock_self(),
+                     "item"_a)
+                .def("remove", &gmic_list_py::remove, nb::lock_self(),
+                     "item"_a);
+        if constexpr (Base::IS_IMAGE) {
+            cls.def_static("from_batch", &gmic_list_py::from_batch,
+                           "array"_a, "layout"_a = nb::none(), nb::kw_only(),
+                           "shared"_a = true, nb::rv_policy::take_ownership,
+                           from_batch_doc)
+                .def("to_batch", &gmic_list_py::to_batch, nb::lock_self(),
+                     "layout"_a = "nczyx", to_batch_doc)
+                .def(
+                    "stats",
+                    [](gmic_list_py &self, const nb::handle &axis) {
+                        return list_stats(self.list().views(), axis);
+                    },
+                    "axis"_a = nb::none(), nb::lock_self(),
+                    "Returns the statistics of each image as a list, as "
+                    "Image.stats does, computed in a single call without "
+                    "the GIL")
+                .def(
+                    "digest",
+                    [](gmic_list_py &self, const string_view algorithm) {
+                        return list_digest(self.list().views(),
+                                           algorithm);
+                    },
+                    "algorithm"_a = "xxh3", nb::lock_self(),
+                    "Returns a digest of the number of images and of the "
+                    "digests of each of them (see Image.digest)")
+                .def_static("from_bytes", &gmic_list_py::from_bytes,
+                            "data"_a, "format"_a = nb::none(),
+                            nb::rv_policy::take_ownership,
+                            "Decodes every frame (or image, for .cimg data) "
+                            "of an encoded image held by a bytes-like object. "
+                            "The format is guessed from the data if not "
+                            "given")
+                .def(
+                    "encode",
+                    [](gmic_list_py &self, const string &format,
+                       const nb::kwargs &options) {
+                        return list_to_bytes(self.list().views(), format,
+                                             options);
+                    },
+                    "format"_a, nb::lock_self(),
+                    "Encodes the images in the given format, which must be "
+                    "TIFF or .cimg unless the list holds a single image. "
+                    "Takes the same options as Image.encode")
+                .def_static(
+                    "from_files",
+                    [](const vector<filesystem::path> &paths,
+                       const size_t prefetch, const unsigned int threads) {
+                        return new image_file_iterator(paths, prefetch,
+                                                       threads);
+                    },
+                    "paths"_a, nb::kw_only(), "prefetch"_a = 4,
+                    "threads"_a = 0, nb::rv_policy::take_ownership,
+                    "Returns an iterator over the images of the given "
+                    "files, in order. Files are read and decoded by up to "
+                    "threads background threads (0 for one per prefetch "
+                    "slot) while the GIL is released, with at most prefetch "
+                    "decoded images waiting to be consumed");
+        }
+        else {
+            cls.def_static("from_list", &gmic_list_py::from_list, "items"_a,
+                           nb::rv_policy::take_ownership,
+                           "Creates a list from a list of str, converting "
+                           "all of them in a single pass")
+                .def("to_list", &gmic_list_py::to_list, nb::lock_self(),
+                     "Returns the strings as a list of str");
+        }
+        nb::module_::import_("collections.abc")
+            .attr("MutableSequence")
+            .attr("register")(cls);
     }
 };
 
@@ -209,75 +1062,251 @@ using gmic_charlist_py = gmic_list_py<char>;
 class interpreter_py {
     using T = gmic_pixel_type;
 
-    static gmic_list_py<> *run(gmic &gmic, const char *cmd,
-                               gmic_list_py<> *img_list,
-                               gmic_charlist_py *img_names)
+    gmic inter{};
+    /// Default number of threads leased by each run (0 = whole budget)
+    atomic<unsigned int> threads;
+    /// Bytes of the images of the run in progress, if any
+    atomic<size_t> run_bytes = 0;
+    /// G'MIC interpreters aren't reentrant, and runs release the GIL
+    mutex mtx;
+    vector<shared_ptr<command_library>> libraries;
+
+    void attach(const shared_ptr<command_library> &lib)
     {
-        if (img_list == nullptr)
-            img_list = new gmic_list_py();
+        nb::gil_scoped_release release;
+        lock_guard lock(mtx);
+        if (ranges::find(libraries, lib) != libraries.end())
+            return;
+        LOG_DEBUG("Attaching " << lib->get_origin() << " to " << this
+                               << endl);
+        inter.add_commands(lib->get_source().c_str(),
+                           lib->get_origin().c_str());
+        libraries.push_back(lib);
+    }
 
-        gmic_charlist_py _names, *names = &_names;
+    nb::object run(const char *cmd, gmic_list_py<> *img_list,
+                   gmic_charlist_py *img_names,
+                   const optional<unsigned int> run_threads,
+                   const bool return_names, const bool cache)
+    {
+        unique_ptr<gmic_list_py<>> new_list;
+        if (img_list == nullptr) {
+            new_list = make_unique<gmic_list_py<>>();
+            img_list = new_list.get();
+        }
+        // Names are only wrapped into a StringList if the caller wants them
+        unique_ptr<gmic_charlist_py> new_names;
+        if (img_names == nullptr && return_names) {
+            new_names = make_unique<gmic_charlist_py>();
+            img_names = new_names.get();
+        }
+        CImgList<char> discarded_names;
+        auto &names = img_names ? img_names->list() : discarded_names;
 
-        if (img_names)
-            names = img_names;
+        auto &slots = img_list->list();
+        // G'MIC modifies images in place
+        for (auto &img : slots)
+            COW.detach(img);
+        const auto wanted_threads = run_threads.value_or(threads.load());
+        // G'MIC's own allocations can't be limited, only runs be held back
+        MEMORY.reserve(0);
 
+        // Runs work on the images moved out of their slots, and outputs are
+        // moved back in order, so that items keep referring to positions
+        CImgList<> list;
+        slots.take(list);
+        const size_t count_before = list.size(),
+                     bytes_before = owned_bytes(list);
+        const auto settle = [&] {
+            if (list.size() > count_before)
+                STATS.image_allocated(0, list.size() - count_before);
+            STATS.image_resized(bytes_before, owned_bytes(list));
+            // Slots past the outputs are removed, and accounted for, here
+            slots.put(list);
+        };
+        bool cached = false;
         try {
-            gmic.run(cmd, img_list->list(), names->list());
+            nb::gil_scoped_release release;
+            lock_guard lock(mtx);
+            const memory_limit::run_usage usage(run_bytes, bytes_before);
+            const auto lease = THREADS.acquire(wanted_threads);
+            string key;
+            if (cache) {
+                key = run_cache::make_key(cmd, libraries, list, names,
+                                          lease.threads());
+                cached = RUN_CACHE.restore(key, list, names);
+            }
+            if (!cached) {
+                try {
+                    run_timer timer;
+                    inter.run(cmd, list, names);
+                }
+                catch (gmic_exception &ex) {
+                    cerr << ex.what();
+                    if (errno)
+                        cerr << ": " << strerror(errno);
+                    cerr << endl;
+                    throw;
+                }
+                if (cache)
+                    RUN_CACHE.store(std::move(key), list, names);
+            }
         }
-        catch (gmic_exception &ex) {
-            cerr << ex.what();
-            if (errno)
-                cerr << ": " << strerror(errno);
-            cerr << endl;
+        catch (...) {
+            settle();
             throw;
         }
+        settle();
 
-        return img_list;
+        auto images = nb::cast(new_list ? new_list.release() : img_list,
+                               nb::rv_policy::take_ownership);
+        if (!return_names)
+            return images;
+        return nb::make_tuple(
+            images, nb::cast(new_names ? new_names.release() : img_names,
+                             nb::rv_policy::take_ownership));
     }
 
-    template <class R, class... Args>
-    static auto make_static_run(R (*)(gmic &gmic, Args... args))
-        -> function<R(Args...)>
+    /**
+     * Interpreter used by the module-level gmic.run(), created on first use.
+     * Process-wide, which is fine as it holds no Python object and the
+     * module can't be loaded into isolated sub-interpreters (see NB_MODULE)
+     */
+    static interpreter_py &static_instance()
     {
-        static unique_ptr<gmic> inter{};
-        return [&](Args... args) {
-            if (!inter)
-                inter = make_unique<gmic>();
-            return run(*inter, args...);
-        };
+        static interpreter_py inter{};
+        return inter;
     }
 
-    static string str(const gmic &inst)
+    static nb::object static_run(const char *cmd, gmic_list_py<> *img_list,
+                                 gmic_charlist_py *img_names,
+                                 const optional<unsigned int> threads,
+                                 const bool return_names, const bool cache)
+    {
+        return static_instance().run(cmd, img_list, img_names, threads,
+                                     return_names, cache);
+    }
+
+    [[nodiscard]] string str() const
     {
         stringstream out;
-        out << '<' << nb::type_name(nb::type<gmic>()).c_str() << " object at "
-            << &inst << '>';
+        out << '<' << nb::type_name(nb::type<interpreter_py>()).c_str()
+            << " object at " << this << '>';
         return out.str();
     }
 
    public:
     constexpr static auto CLASSNAME = "Gmic";
+    static constexpr auto threads_doc =
+        "Maximum number of threads a run may lease from the process-wide "
+        "budget set by gmic.set_num_threads() (0 for the whole budget)";
+    static constexpr auto run_doc =
+        "Runs a G'MIC command on the given images (or on a new list), and "
+        "returns them. If return_names is set, returns an (images, names) "
+        "tuple instead, names being img_names or a new StringList. If cache "
+        "is set, the output is looked up in the process-wide cache of run "
+        "outputs (see gmic.set_run_cache_size) by command, G'MIC and library "
+        "versions and digests of the input images and names, and copied "
+        "from it instead of running the command if found. Only commands "
+        "whose output depends on nothing but their inputs may be cached";
+
+    explicit interpreter_py(
+        const optional<unsigned int> threads = {},
+        const vector<shared_ptr<command_library>> &libraries = {})
+        : threads(threads.value_or(0))
+    {
+        for (const auto &lib : libraries)
+            attach(lib);
+    }
 
     static void bind(nb::module_ &m)
     {
         LOG_DEBUG("Binding G'MIC." << CLASSNAME << " class" << endl);
-        nb::class_<gmic>(m, CLASSNAME, "G'MIC interpreter")
+        nb::class_<interpreter_py>(m, CLASSNAME, "G'MIC interpreter")
+            .def(nb::init<optional<unsigned int>,
+                          const vector<shared_ptr<command_library>> &>(),
+                 "threads"_a = nb::none(),
+                 "libraries"_a = vector<shared_ptr<command_library>>{})
             .def("run", &interpreter_py::run, "cmd"_a,
                  "img_list"_a = nb::none(), "img_names"_a = nb::none(),
-                 nb::rv_policy::take_ownership)
-            .def("__str__", &interpreter_py::str)
-            .def(nb::init());
+                 "threads"_a = nb::none(), nb::kw_only(),
+                 "return_names"_a = false, "cache"_a = false, run_doc)
+            .def_prop_rw(
+                "threads",
+                [](const interpreter_py &self) { return self.threads.load(); },
+                [](interpreter_py &self, const unsigned int threads) {
+                    self.threads = threads;
+                },
+                threads_doc)
+            .def_prop_ro(
+                "run_bytes",
+                [](const interpreter_py &self) {
+                    return self.run_bytes.load();
+                },
+                "Bytes of the images the run in progress works on (0 when "
+                "idle), as summed up in gmic.memory_info()")
+            .def("attach", &interpreter_py::attach, "library"_a,
+                 "Adds the commands of a gmic.CommandLibrary to the "
+                 "interpreter. Attaching an already attached library does "
+                 "nothing")
+            .def_prop_ro(
+                "libraries",
+                [](interpreter_py &self) {
+                    // Copied, as runs and attach() may be in progress
+                    nb::gil_scoped_release release;
+                    lock_guard lock(self.mtx);
+                    return self.libraries;
+                },
+                "Command libraries attached to the interpreter")
+            .def("__str__", &interpreter_py::str);
 
-        m.def("run", make_static_run(&interpreter_py::run), "cmd"_a,
+        m.def("run", &interpreter_py::static_run, "cmd"_a,
               "img_list"_a = nb::none(), "img_names"_a = nb::none(),
-              nb::rv_policy::take_ownership);
+              "threads"_a = nb::none(), nb::kw_only(),
+              "return_names"_a = false, "cache"_a = false, run_doc);
     }
 };
 
 void bind_gmic_list(nanobind::module_ &m)
 {
+    image_file_iterator::bind(m);
     gmic_list_py<>::bind(m);
     gmic_list_py<char>::bind(m);
+    m.def("decode_many", &gmic_list_py<>::decode_many, "sources"_a,
+          "format"_a = nb::none(), nb::kw_only(), "threads"_a = 0,
+          nb::rv_policy::take_ownership,
+          "Decodes images from paths or bytes-like objects (as "
+          "Image.from_bytes) in parallel, with the GIL released, and returns "
+          "them as an ImageList in the same order. Up to threads threads are "
+          "leased from the budget set by gmic.set_num_threads() (0 for all "
+          "of it)");
+    m.def(
+        "encode_many",
+        [](const nb::handle &images, const string &format,
+           const unsigned int threads, const nb::kwargs &options) {
+            vector<const CImg<> *> ptrs;
+            // Keeps images alive if they come from a generator
+            vector<nb::object> refs;
+            if (nb::isinstance<gmic_list_py<>>(images)) {
+                for (const auto &img :
+                     nb::cast<gmic_list_py<> &>(images).list())
+                    ptrs.push_back(&img);
+            }
+            else {
+                for (const auto &img : images) {
+                    ptrs.push_back(&nb::cast<const CImg<> &>(img));
+                    refs.push_back(nb::borrow(img));
+                }
+            }
+            return encode_many(ptrs, format, options, threads);
+        },
+        "images"_a, "format"_a, nb::kw_only(), "threads"_a = 0,
+        "Encodes images (as Image.encode, with the same options) in "
+        "parallel, with the GIL released, and returns a list of bytes in the "
+        "same order. Up to threads threads are leased from the budget set by "
+        "gmic.set_num_threads() (0 for all of it)");
+    command_library::bind(m);
+    stream_py::bind(m);
     interpreter_py::bind(m);
 }
 
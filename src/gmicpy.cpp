@@ -65,8 +65,25 @@ constexpr array<char, N> get_gmic_version()
     return to_array(version);
 }
 
-NB_MODULE(gmic, m)
+/**
+ * Instruction set the module is built for. CMakeLists.txt builds it once per
+ * instruction set, as gmic._core_<isa>, and gmic/__init__.py imports one.
+ */
+#ifndef GMICPY_ISA
+#define GMICPY_ISA baseline
+#endif
+#define GMICPY_CORE_MODULE(isa, variable) NB_MODULE(_core_##isa, variable)
+#define GMICPY_NB_MODULE(isa, variable) GMICPY_CORE_MODULE(isa, variable)
+
+// Single-phase initialization: nanobind keeps its type registry in
+// process-wide internals, so the module can't be isolated per interpreter
+// and Python refuses to import it into sub-interpreters with their own GIL
+GMICPY_NB_MODULE(GMICPY_ISA, m)
 try {
+    // Named after the package, which re-exports the module's attributes, so
+    // that its classes and functions are gmic.Image, gmic.run... wherever
+    // they are shown or pickled
+    m.attr("__name__") = "gmic";
 #if DEBUG == 1
     LOG = DebugLogger{&cerr, Level::Nothing};
     if (auto loglevel = getenv("GMICPY_LOGLEVEL")) {
@@ -96,11 +113,11 @@ try {
                                                       : nullptr)            \
     }
 
-        static char build[256];
+        // Attributes are copied into Python strings, no static buffer needed
         stringstream build_str;
         build_str << "Built on " __DATE__ << " at " << __TIME__;
-        strncpy(build, build_str.str().c_str(), size(build));
-        m.attr("__build__") = build;
+        m.attr("__build__") = build_str.str();
+
         const map<const char *, const char *> flags{
             IS_DEFINED(DEBUG),  // NOLINT(*-branch-clone)
             IS_DEFINED(__cplusplus),
@@ -124,7 +141,9 @@ try {
             IS_DEFINED(cimg_use_vt100),
             IS_DEFINED(cimg_use_xrandr),
             IS_DEFINED(cimg_use_xshm),
-            IS_DEFINED(cimg_use_zlib)};
+            IS_DEFINED(cimg_use_zlib),
+            // gmic/__init__.py adds the module imported and the ones built
+            {"GMICPY_ISA", Py_STRINGIFY(GMICPY_ISA)}};
         m.attr("__build_flags__") = flags;
     }
 
@@ -138,6 +157,14 @@ try {
     LOG_INFO("Binding gmic module" << endl);
     bind_gmic_image(m);
     bind_gmic_list(m);
+    bind_stats(m);
+    bind_threads(m);
+    bind_run_cache(m);
+    bind_cow(m);
+    bind_memory(m);
+    bind_volume(m);
+    bind_expression(m);
+    bind_lazy_image(m);
 
     LOG_DEBUG("Binding gmic.GmicException class" << endl);
     const auto gmic_ex = nb::exception<  // NOLINT(*-throw-keyword-missing)
@@ -8,7 +8,9 @@
 #include <nanobind/stl/filesystem.h>
 #include <nanobind/stl/map.h>
 #include <nanobind/stl/optional.h>
+#include <nanobind/stl/shared_ptr.h>
 #include <nanobind/stl/string.h>
+#include <nanobind/stl/string_view.h>
 #include <nanobind/stl/tuple.h>
 #include <nanobind/stl/vector.h>
 
@@ -21,12 +23,16 @@
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <ranges>
 #include <sstream>
 #include <type_traits>
+#include <unordered_map>
 
 #include "logging.hpp"
+#include "stats.hpp"
+#include "threads.hpp"
 
 #ifdef __GNUC__
 #include <cxxabi.h>
@@ -35,6 +41,14 @@
 namespace gmicpy {
 void bind_gmic_image(const nanobind::module_ &m);
 void bind_gmic_list(nanobind::module_ &m);
+void bind_stats(nanobind::module_ &m);
+void bind_threads(nanobind::module_ &m);
+void bind_run_cache(nanobind::module_ &m);
+void bind_cow(nanobind::module_ &m);
+void bind_memory(nanobind::module_ &m);
+void bind_volume(nanobind::module_ &m);
+void bind_expression(nanobind::module_ &m);
+void bind_lazy_image(nanobind::module_ &m);
 }  // namespace gmicpy
 
 #endif  // GMICPY_H
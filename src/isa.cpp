@@ -0,0 +1,42 @@
+#include <nanobind/nanobind.h>
+#include <nanobind/stl/string_view.h>
+
+#include <string_view>
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+
+/**
+ * Whether the CPU (and OS) supports an instruction set the module can be
+ * built for. Checks everything the compile options of that variant enable
+ * in CMakeLists.txt, which must be kept in sync.
+ */
+static bool cpu_supports(const string_view isa)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    const bool avx2 =
+        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (isa == "avx2")
+        return avx2;
+    if (isa == "avx512")
+        return avx2 && __builtin_cpu_supports("avx512f") &&
+               __builtin_cpu_supports("avx512bw") &&
+               __builtin_cpu_supports("avx512dq") &&
+               __builtin_cpu_supports("avx512vl");
+#endif
+    return isa == "baseline";
+}
+
+}  // namespace gmicpy
+
+// Only loads the variant-independent code gmic/__init__.py needs to pick
+// the gmic._core_<isa> module to import
+NB_MODULE(_isa, m)
+{
+    m.def("cpu_supports", &gmicpy::cpu_supports, "isa"_a,
+          "Whether the CPU supports the instruction set of a "
+          "gmic._core_<isa> module: 'baseline', 'avx2' or 'avx512'");
+}
@@ -0,0 +1,541 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+
+#if cimg_use_openmp != 0
+#include <omp.h>
+#endif
+
+// Static, so that xxHash's implementations for the module's instruction
+// set (picked at compile time) are inlined into the kernels
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+namespace gmicpy::kernels {
+using namespace std;
+
+namespace {
+
+/// Values processed by each task of a single operation
+constexpr size_t CHUNK = 8192;
+/// Values processed at once by fused programs, whose steps stay in cache
+constexpr size_t BLOCK = 512;
+
+/// Applies f to a row of n values, operands having x strides of 1 or 0
+template <class T, class F>
+void row(T *out, const T *a, const size_t sa, const T *b, const size_t sb,
+         const size_t n, F f)
+{
+    if (sa && sb) {
+        for (size_t i = 0; i < n; i++)
+            out[i] = f(a[i], b[i]);
+    }
+    else if (sa) {
+        const T vb = *b;
+        for (size_t i = 0; i < n; i++)
+            out[i] = f(a[i], vb);
+    }
+    else if (sb) {
+        const T va = *a;
+        for (size_t i = 0; i < n; i++)
+            out[i] = f(va, b[i]);
+    }
+    else {
+        fill_n(out, n, f(*a, *b));
+    }
+}
+
+/// Remainder of x / y of the sign of y, as in Python
+template <class T>
+T mod(const T x, const T y)
+{
+    const T m = std::fmod(x, y);
+    return m != 0 && (m < 0) != (y < 0) ? m + y : m;
+}
+
+/**
+ * Rounded down quotient of x / y, computed from the exact remainder as in
+ * Python (floor(x / y) may be off by one because of the rounded division)
+ */
+template <class T>
+T floor_div(const T x, const T y)
+{
+    if (y == 0)
+        return x / y;
+    const T m = std::fmod(x, y);
+    T div = (x - m) / y;
+    if (m != 0 && (m < 0) != (y < 0))
+        div -= 1;
+    const T floored = std::floor(div);
+    return div - floored > T(0.5) ? floored + 1 : floored;
+}
+
+/// Calls visit with the elementwise function of an operation
+template <class T, class V>
+void dispatch(const binary_op op, V visit)
+{
+    // Bitwise operations work on the integer part of values, like G'MIC's
+    using I = int64_t;
+    switch (op) {
+        case binary_op::ADD:
+            return visit([](T x, T y) { return x + y; });
+        case binary_op::SUB:
+            return visit([](T x, T y) { return x - y; });
+        case binary_op::MUL:
+            return visit([](T x, T y) { return x * y; });
+        case binary_op::DIV:
+            return visit([](T x, T y) { return x / y; });
+        case binary_op::FLOOR_DIV:
+            return visit([](T x, T y) { return floor_div(x, y); });
+        case binary_op::MOD:
+            return visit([](T x, T y) { return mod(x, y); });
+        case binary_op::POW:
+            return visit([](T x, T y) { return std::pow(x, y); });
+        case binary_op::MIN:
+            return visit([](T x, T y) { return y < x ? y : x; });
+        case binary_op::MAX:
+            return visit([](T x, T y) { return x < y ? y : x; });
+        case binary_op::LT:
+            return visit([](T x, T y) { return static_cast<T>(x < y); });
+        case binary_op::LE:
+            return visit([](T x, T y) { return static_cast<T>(x <= y); });
+        case binary_op::GT:
+            return visit([](T x, T y) { return static_cast<T>(x > y); });
+        case binary_op::GE:
+            return visit([](T x, T y) { return static_cast<T>(x >= y); });
+        case binary_op::EQ:
+            return visit([](T x, T y) { return static_cast<T>(x == y); });
+        case binary_op::NE:
+            return visit([](T x, T y) { return static_cast<T>(x != y); });
+        case binary_op::AND:
+            return visit([](T x, T y) {
+                return static_cast<T>(static_cast<I>(x) & static_cast<I>(y));
+            });
+        case binary_op::OR:
+            return visit([](T x, T y) {
+                return static_cast<T>(static_cast<I>(x) | static_cast<I>(y));
+            });
+        case binary_op::XOR:
+            return visit([](T x, T y) {
+                return static_cast<T>(static_cast<I>(x) ^ static_cast<I>(y));
+            });
+        case binary_op::COUNT:
+            break;
+    }
+}
+
+/**
+ * Stride with which an operand can be walked like a single row of the
+ * output: 1 if it is dense, 0 if it is a scalar, none otherwise
+ */
+template <class T>
+optional<size_t> linear_stride(const operand<T> &o, const shape4 &shape)
+{
+    size_t dense = 1;
+    bool is_dense = true, is_scalar = true;
+    for (size_t axis = 0; axis < 4; axis++) {
+        if (shape[axis] > 1) {
+            is_dense = is_dense && o.strides[axis] == dense;
+            is_scalar = is_scalar && o.strides[axis] == 0;
+        }
+        dense *= shape[axis];
+    }
+    if (is_scalar)
+        return 0;
+    if (is_dense)
+        return 1;
+    return nullopt;
+}
+
+/**
+ * Splits the output into segments of up to chunk values along rows, and
+ * calls segment(offset, n, locate) for each of them on up to threads
+ * threads, where locate(o) points to the values of operand o for the
+ * segment. When no operand is broadcast along y, z or c, the whole buffer
+ * is walked as a single row and the operands' strides are updated
+ * accordingly.
+ */
+template <class T, class S>
+void for_each_segment(shape4 shape, const span<operand<T>> operands,
+                      const size_t chunk,
+                      [[maybe_unused]] const unsigned int threads, S segment)
+{
+    const size_t total = shape[0] * shape[1] * shape[2] * shape[3];
+    if (ranges::all_of(operands, [&](const operand<T> &o) {
+            return linear_stride(o, shape).has_value();
+        })) {
+        for (auto &o : operands)
+            o.strides = {*linear_stride(o, shape), 0, 0, 0};
+        shape = {total, 1, 1, 1};
+    }
+
+    const size_t W = shape[0], H = shape[1], D = shape[2];
+    const size_t per_row = (W + chunk - 1) / chunk;
+    const auto tasks = static_cast<long>(per_row * H * D * shape[3]);
+#if cimg_use_openmp != 0
+#pragma omp parallel for num_threads(static_cast<int>(threads)) \
+    if (total >= PARALLEL_VALUES)
+#endif
+    for (long t = 0; t < tasks; t++) {
+        const size_t r = t / per_row, x0 = t % per_row * chunk;
+        const size_t y = r % H, z = r / H % D, c = r / (H * D);
+        const auto locate = [&](const operand<T> &o) {
+            return o.data + x0 * o.strides[0] + y * o.strides[1] +
+                   z * o.strides[2] + c * o.strides[3];
+        };
+        segment(r * W + x0, min(chunk, W - x0), locate);
+    }
+}
+
+
+/// Independent accumulators of reductions, so that they can be vectorised
+constexpr size_t LANES = 8;
+constexpr double INF = numeric_limits<double>::infinity();
+
+/// Summary of n contiguous values, from two passes over them
+template <class T>
+summary summarize_row(const T *v, const size_t n)
+{
+    array<double, LANES> mn, mx, sum{}, m2{};
+    mn.fill(INF);
+    mx.fill(-INF);
+    const size_t whole = n / LANES * LANES;
+    for (size_t i = 0; i < whole; i += LANES) {
+        for (size_t l = 0; l < LANES; l++) {
+            const double x = v[i + l];
+            mn[l] = x < mn[l] ? x : mn[l];
+            mx[l] = mx[l] < x ? x : mx[l];
+            sum[l] += x;
+        }
+    }
+    for (size_t i = whole; i < n; i++) {
+        const double x = v[i];
+        mn[0] = x < mn[0] ? x : mn[0];
+        mx[0] = mx[0] < x ? x : mx[0];
+        sum[0] += x;
+    }
+    summary s;
+    s.count = n;
+    for (size_t l = 0; l < LANES; l++) {
+        s.min = mn[l] < s.min ? mn[l] : s.min;
+        s.max = s.max < mx[l] ? mx[l] : s.max;
+        s.sum += sum[l];
+    }
+    // Second pass while the values are still in cache
+    s.mean = s.sum / static_cast<double>(n);
+    for (size_t i = 0; i < whole; i += LANES) {
+        for (size_t l = 0; l < LANES; l++) {
+            const double d = v[i + l] - s.mean;
+            m2[l] += d * d;
+        }
+    }
+    for (size_t i = whole; i < n; i++) {
+        const double d = v[i] - s.mean;
+        m2[0] += d * d;
+    }
+    for (size_t l = 0; l < LANES; l++)
+        s.m2 += m2[l];
+    return s;
+}
+
+/// Summaries of a row of cells, each receiving one value per added row
+class cell_row {
+    size_t count = 0;
+    vector<double> min, max, sum, mean, m2;
+
+   public:
+    explicit cell_row(const size_t n)
+        : min(n, INF), max(n, -INF), sum(n), mean(n), m2(n)
+    {
+    }
+
+    /// Welford's update, vectorised across cells as all counts are equal
+    template <class T>
+    void add(const T *v)
+    {
+        const double inv = 1. / static_cast<double>(++count);
+        for (size_t i = 0; i < min.size(); i++) {
+            const double x = v[i];
+            min[i] = x < min[i] ? x : min[i];
+            max[i] = max[i] < x ? x : max[i];
+            sum[i] += x;
+            const double d = x - mean[i];
+            mean[i] += d * inv;
+            m2[i] += d * (x - mean[i]);
+        }
+    }
+
+    [[nodiscard]] vector<summary> summaries() const
+    {
+        vector<summary> result(min.size());
+        for (size_t i = 0; i < result.size(); i++)
+            result[i] = {count, min[i], max[i], sum[i], mean[i], m2[i]};
+        return result;
+    }
+};
+
+}  // namespace
+
+optional<shape4> broadcast(const shape4 &a, const shape4 &b)
+{
+    shape4 result{};
+    for (size_t axis = 0; axis < 4; axis++) {
+        if (a[axis] != b[axis] && a[axis] != 1 && b[axis] != 1)
+            return nullopt;
+        result[axis] = max(a[axis], b[axis]);
+    }
+    return result;
+}
+
+template <class T>
+operand<T> dense_operand(const T *data, const shape4 &shape)
+{
+    operand<T> o{data, {}};
+    size_t stride = 1;
+    for (size_t axis = 0; axis < 4; axis++) {
+        o.strides[axis] = shape[axis] == 1 ? 0 : stride;
+        stride *= shape[axis];
+    }
+    return o;
+}
+
+template <class T>
+void apply(const binary_op op, T *out, const shape4 &shape,
+           const operand<T> &a, const operand<T> &b,
+           const unsigned int threads)
+{
+    array<operand<T>, 2> operands{a, b};
+    dispatch<T>(op, [&](auto f) {
+        for_each_segment<T>(
+            shape, operands, CHUNK, threads,
+            [&](const size_t offset, const size_t n, const auto &locate) {
+                row(out + offset, locate(operands[0]),
+                    operands[0].strides[0], locate(operands[1]),
+                    operands[1].strides[0], n, f);
+            });
+    });
+}
+
+template <class T>
+void evaluate(const fused_program<T> &program, T *out, const shape4 &shape,
+              const unsigned int threads)
+{
+    auto leaves = program.leaves;
+    const size_t steps = program.steps.size();
+    for_each_segment<T>(
+        shape, leaves, BLOCK, threads,
+        [&](const size_t offset, const size_t n, const auto &locate) {
+            // Intermediate results of the block, one row per step
+            thread_local vector<T> registers;
+            registers.resize(steps * BLOCK);
+            const auto source = [&](const int i, const T *&ptr,
+                                    size_t &stride) {
+                if (i < 0) {
+                    ptr = locate(leaves[~i]);
+                    stride = leaves[~i].strides[0];
+                }
+                else {
+                    ptr = registers.data() + i * BLOCK;
+                    stride = 1;
+                }
+            };
+            for (size_t s = 0; s < steps; s++) {
+                const auto &step = program.steps[s];
+                const T *a, *b;
+                size_t sa, sb;
+                source(step.a, a, sa);
+                source(step.b, b, sb);
+                T *dst = s + 1 == steps ? out + offset
+                                        : registers.data() + s * BLOCK;
+                dispatch<T>(step.op,
+                            [&](auto f) { row(dst, a, sa, b, sb, n, f); });
+            }
+        });
+}
+
+void summary::merge(const summary &other)
+{
+    if (!other.count)
+        return;
+    const auto na = static_cast<double>(count),
+               nb = static_cast<double>(other.count);
+    const double d = other.mean - mean;
+    mean += d * nb / (na + nb);
+    m2 += other.m2 + d * d * na * nb / (na + nb);
+    count += other.count;
+    min = other.min < min ? other.min : min;
+    max = max < other.max ? other.max : max;
+    sum += other.sum;
+}
+
+template <class T>
+vector<summary> summarize(const T *data, const shape4 &dims,
+                          const array<bool, 4> &reduced,
+                          [[maybe_unused]] const unsigned int threads)
+{
+    // Axes after x with the same status as x are walked as part of its rows
+    shape4 shape = dims;
+    for (size_t axis = 1; axis < 4 && reduced[axis] == reduced[0]; axis++) {
+        shape[0] *= shape[axis];
+        shape[axis] = 1;
+    }
+    const size_t W = shape[0];
+    // Kept cells along y, z and c, and rows reduced into each of them
+    size_t tasks = 1, rows = 1;
+    for (size_t axis = 1; axis < 4; axis++)
+        (reduced[axis] ? rows : tasks) *= shape[axis];
+    [[maybe_unused]] const size_t total = W * rows * tasks;
+    const auto row_at = [&](size_t t, size_t j) {
+        size_t offset = 0, stride = W;
+        for (size_t axis = 1; axis < 4; axis++) {
+            size_t &index = reduced[axis] ? j : t;
+            offset += index % shape[axis] * stride;
+            index /= shape[axis];
+            stride *= shape[axis];
+        }
+        return data + offset;
+    };
+
+    if (!reduced[0]) {
+        // Segments of rows, each accumulating the rows reduced into it
+        const size_t per_task = (W + CHUNK - 1) / CHUNK;
+        vector<summary> result(tasks * W);
+        const auto items = static_cast<long>(tasks * per_task);
+#if cimg_use_openmp != 0
+#pragma omp parallel for num_threads(static_cast<int>(threads)) \
+    if (total >= PARALLEL_VALUES)
+#endif
+        for (long item = 0; item < items; item++) {
+            const size_t t = item / per_task,
+                         x0 = item % per_task * CHUNK;
+            cell_row cells(min(CHUNK, W - x0));
+            for (size_t j = 0; j < rows; j++)
+                cells.add(row_at(t, j) + x0);
+            ranges::copy(cells.summaries(), result.begin() + t * W + x0);
+        }
+        return result;
+    }
+
+    // Each task is split in parts when there are too few of them for the
+    // threads, their partial summaries being merged afterwards
+    const size_t per_row = (W + CHUNK - 1) / CHUNK, units = rows * per_row;
+    size_t parts = 1;
+#if cimg_use_openmp != 0
+    if (total >= PARALLEL_VALUES && tasks < threads)
+        parts = min(units, (threads + tasks - 1) / tasks);
+#endif
+    vector<summary> partials(tasks * parts);
+    const auto items = static_cast<long>(partials.size());
+#if cimg_use_openmp != 0
+#pragma omp parallel for num_threads(static_cast<int>(threads)) \
+    if (total >= PARALLEL_VALUES)
+#endif
+    for (long item = 0; item < items; item++) {
+        const size_t t = item / parts, p = item % parts;
+        for (size_t u = units * p / parts; u < units * (p + 1) / parts;
+             u++) {
+            const size_t x0 = u % per_row * CHUNK;
+            partials[item].merge(summarize_row(row_at(t, u / per_row) + x0,
+                                               min(CHUNK, W - x0)));
+        }
+    }
+    vector<summary> result(tasks);
+    for (size_t t = 0; t < tasks; t++)
+        for (size_t p = 0; p < parts; p++)
+            result[t].merge(partials[t * parts + p]);
+    return result;
+}
+
+template <class T>
+void histogram(const T *data, const size_t n, const double min,
+               const double max, int64_t *counts, const size_t bins,
+               [[maybe_unused]] const unsigned int threads)
+{
+    fill_n(counts, bins, 0);
+    const double width = max - min;
+    const auto count = [&](const size_t first, const size_t last,
+                           int64_t *local) {
+        for (size_t i = first; i < last; i++) {
+            const double v = data[i];
+            if (!(v >= min && v <= max))
+                continue;
+            // Multiplied first, so that bin edges are exact when possible
+            const auto bin = static_cast<size_t>((v - min) *
+                                                 static_cast<double>(bins) /
+                                                 width);
+            local[bin < bins ? bin : bins - 1]++;
+        }
+    };
+#if cimg_use_openmp != 0
+    if (n >= PARALLEL_VALUES && threads > 1) {
+        const auto tasks = static_cast<long>(threads);
+#pragma omp parallel for num_threads(static_cast<int>(threads))
+        for (long t = 0; t < tasks; t++) {
+            vector<int64_t> local(bins);
+            count(n * t / tasks, n * (t + 1) / tasks, local.data());
+#pragma omp critical
+            for (size_t b = 0; b < bins; b++)
+                counts[b] += local[b];
+        }
+        return;
+    }
+#endif
+    count(0, n, counts);
+}
+
+uint64_t hash(const hash_algorithm algorithm, const void *data,
+              const size_t size)
+{
+    return algorithm == hash_algorithm::XXH3 ? XXH3_64bits(data, size)
+                                             : XXH64(data, size, 0);
+}
+
+uint64_t tree_digest(const hash_algorithm algorithm, const void *header,
+                     const size_t header_size, const void *data,
+                     const size_t size,
+                     [[maybe_unused]] const unsigned int threads)
+{
+    const size_t blocks = (size + DIGEST_BLOCK - 1) / DIGEST_BLOCK;
+    vector<uint64_t> hashed(blocks + 1);
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    const auto n = static_cast<long>(blocks);
+#if cimg_use_openmp != 0
+#pragma omp parallel for num_threads(static_cast<int>(threads)) if (n > 1)
+#endif
+    for (long b = 0; b < n; b++) {
+        const size_t offset = b * DIGEST_BLOCK;
+        hashed[b + 1] =
+            hash(algorithm, bytes + offset, min(DIGEST_BLOCK, size - offset));
+    }
+    hashed[0] = hash(algorithm, header, header_size);
+    return hash(algorithm, hashed.data(), hashed.size() * sizeof(uint64_t));
+}
+
+template operand<float> dense_operand(const float *, const shape4 &);
+template operand<double> dense_operand(const double *, const shape4 &);
+template void apply<float>(binary_op, float *, const shape4 &,
+                           const operand<float> &, const operand<float> &,
+                           unsigned int);
+template void apply<double>(binary_op, double *, const shape4 &,
+                            const operand<double> &, const operand<double> &,
+                            unsigned int);
+template void evaluate<float>(const fused_program<float> &, float *,
+                              const shape4 &, unsigned int);
+template void evaluate<double>(const fused_program<double> &, double *,
+                               const shape4 &, unsigned int);
+
+template vector<summary> summarize<float>(const float *, const shape4 &,
+                                         const array<bool, 4> &,
+                                         unsigned int);
+template vector<summary> summarize<double>(const double *, const shape4 &,
+                                          const array<bool, 4> &,
+                                          unsigned int);
+template void histogram<float>(const float *, size_t, double, double,
+                               int64_t *, size_t, unsigned int);
+template void histogram<double>(const double *, size_t, double, double,
+                                int64_t *, size_t, unsigned int);
+
+}  // namespace gmicpy::kernels
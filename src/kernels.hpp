@@ -0,0 +1,148 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace gmicpy::kernels {
+
+/// Elementwise binary operations. Comparisons yield 1 or 0.
+enum class binary_op : uint8_t {
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    FLOOR_DIV,
+    MOD,
+    POW,
+    MIN,
+    MAX,
+    LT,
+    LE,
+    GT,
+    GE,
+    EQ,
+    NE,
+    AND,
+    OR,
+    XOR,
+    COUNT
+};
+
+/// Sizes of a 4D buffer, in xyzc order
+using shape4 = std::array<size_t, 4>;
+
+/**
+ * Input of a kernel: a 4D buffer with strides in values, in xyzc order. A
+ * stride of 0 repeats the values along that axis (broadcasting), so that a
+ * scalar is a single value with null strides.
+ */
+template <class T>
+struct operand {
+    const T *data;
+    std::array<size_t, 4> strides;
+};
+
+/// Shape of the result of an operation, broadcasting axes of size 1
+std::optional<shape4> broadcast(const shape4 &a, const shape4 &b);
+
+/// Operand reading a planar buffer, broadcast along its axes of size 1
+template <class T>
+operand<T> dense_operand(const T *data, const shape4 &shape);
+
+/// Minimum number of values for kernels to use several threads
+constexpr size_t PARALLEL_VALUES = size_t{1} << 16;
+
+/**
+ * Computes out = a op b over a planar buffer of the given shape, on up to
+ * threads OpenMP threads. Operands must have x strides of 1 or 0: inner
+ * loops then run over contiguous rows, which the compiler vectorises. out
+ * may be the same buffer as an operand with the same strides, but must not
+ * overlap it otherwise.
+ */
+template <class T>
+void apply(binary_op op, T *out, const shape4 &shape, const operand<T> &a,
+           const operand<T> &b, unsigned int threads);
+
+/**
+ * Chain of operations evaluated in a single pass: steps are computed block
+ * by block, so that intermediate results stay in cache instead of going
+ * through full-size temporaries.
+ */
+template <class T>
+struct fused_program {
+    /// Operation on two leaves (~index) or results of previous steps
+    struct step {
+        binary_op op;
+        int a, b;
+    };
+
+    std::vector<operand<T>> leaves;
+    /// Steps in evaluation order, the last one giving the result
+    std::vector<step> steps;
+};
+
+/**
+ * Evaluates a fused program into out, with the same rules as apply() for
+ * its leaves and out. Needs at least one step.
+ */
+template <class T>
+void evaluate(const fused_program<T> &program, T *out, const shape4 &shape,
+              unsigned int threads);
+
+/// Count, extrema, sum and centred second moment of a set of values
+struct summary {
+    size_t count = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+    double sum = 0, mean = 0, m2 = 0;
+
+    /// Adds the values summarised by other (pairwise update of Chan et al.)
+    void merge(const summary &other);
+};
+
+/**
+ * Summarises a planar buffer over the axes flagged in reduced, on up to
+ * threads OpenMP threads. Returns one summary per point of the buffer with
+ * its reduced axes of size 1, in planar order. Values are accumulated in
+ * double precision, over blocks of independent lanes that the compiler
+ * vectorises.
+ */
+template <class T>
+std::vector<summary> summarize(const T *data, const shape4 &shape,
+                               const std::array<bool, 4> &reduced,
+                               unsigned int threads);
+
+/**
+ * Counts the n values of data falling in each of bins equal intervals of
+ * [min, max] (the last one including max) into counts. Other values, NaN
+ * included, aren't counted.
+ */
+template <class T>
+void histogram(const T *data, size_t n, double min, double max,
+               int64_t *counts, size_t bins, unsigned int threads);
+
+/// Hash functions of digests, from the vendored xxHash, with a seed of 0
+enum class hash_algorithm : uint8_t { XXH3, XXH64 };
+
+/// 64-bit XXH3 or XXH64 hash of a buffer
+uint64_t hash(hash_algorithm algorithm, const void *data, size_t size);
+
+/// Bytes hashed separately, and possibly concurrently, by tree_digest()
+constexpr size_t DIGEST_BLOCK = size_t{1} << 20;
+
+/**
+ * Digest of a header followed by a buffer: the hash of the hashes of the
+ * header and of the buffer's blocks of DIGEST_BLOCK bytes, which are hashed
+ * on up to threads threads. The result doesn't depend on threads.
+ */
+uint64_t tree_digest(hash_algorithm algorithm, const void *header,
+                     size_t header_size, const void *data, size_t size,
+                     unsigned int threads);
+
+}  // namespace gmicpy::kernels
+
+#endif  // KERNELS_HPP
@@ -0,0 +1,237 @@
+#include "lazy_image.hpp"
+
+#include "cow.hpp"
+#include "memory.hpp"
+#include "operators.hpp"
+#include "utils.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+using namespace cimg_library;
+
+static kernels::shape4 shape_of(const CImg<gmic_pixel_type> &img)
+{
+    return {img._width, img._height, img._depth, img._spectrum};
+}
+
+lazy_image_py lazy_image_py::of(const nb::handle &img)
+{
+    const auto &leaf = nb::cast<const Img &>(img);
+    if (!leaf.data())
+        throw runtime_error("Image has no data");
+    return lazy_image_py(
+        make_shared<const node>(node{shape_of(leaf), nb::borrow(img)}));
+}
+
+optional<lazy_image_py> lazy_image_py::from(const nb::handle &obj)
+{
+    if (nb::isinstance<lazy_image_py>(obj))
+        return nb::cast<const lazy_image_py &>(obj);
+    if (nb::isinstance<Img>(obj))
+        return of(obj);
+    T value;
+    if (nb::try_cast(obj, value))
+        return lazy_image_py(
+            make_shared<const node>(node{{1, 1, 1, 1}, {}, value}));
+    return nullopt;
+}
+
+lazy_image_py lazy_image_py::combine(const kernels::binary_op op,
+                                     const lazy_image_py &other,
+                                     const bool reflected) const
+{
+    const auto &a = reflected ? other.root : root,
+               &b = reflected ? root : other.root;
+    const auto result_shape = kernels::broadcast(a->shape, b->shape);
+    if (!result_shape)
+        throw nb::value_error(
+            ("Operands could not be broadcast together with shapes " +
+             shape_to_string(a->shape) + " and " + shape_to_string(b->shape))
+                .c_str());
+    return lazy_image_py(
+        make_shared<const node>(node{*result_shape, {}, 0, op, a, b}));
+}
+
+int lazy_image_py::compile(const node &n, kernels::fused_program<T> &program,
+                           vector<const Img *> &images,
+                           map<const node *, int> &compiled)
+{
+    if (const auto it = compiled.find(&n); it != compiled.end())
+        return it->second;
+    int index;
+    if (n.a) {
+        const int a = compile(*n.a, program, images, compiled),
+                  b = compile(*n.b, program, images, compiled);
+        program.steps.push_back({n.op, a, b});
+        index = static_cast<int>(program.steps.size()) - 1;
+    }
+    else {
+        kernels::operand<T> leaf{&n.value, {}};
+        if (n.image.is_valid()) {
+            const auto &img = nb::cast<const Img &>(n.image);
+            if (shape_of(img) != n.shape)
+                throw nb::value_error(
+                    "An image of the expression was resized since it was "
+                    "built");
+            leaf = kernels::dense_operand(img.data(), n.shape);
+            images.push_back(&img);
+        }
+        program.leaves.push_back(leaf);
+        index = ~static_cast<int>(program.leaves.size() - 1);
+    }
+    compiled.emplace(&n, index);
+    return index;
+}
+
+void lazy_image_py::evaluate(Img &out) const
+{
+    static constexpr T ZERO = 0;
+    kernels::fused_program<T> program;
+    vector<const Img *> images;
+    map<const node *, int> compiled;
+    if (compile(*root, program, images, compiled) < 0) {
+        // A single image is copied by adding 0
+        program.leaves.push_back({&ZERO, {}});
+        program.steps.push_back({kernels::binary_op::ADD, ~0, ~1});
+    }
+
+    // Blocks are read before being written, so only images sharing memory
+    // with out other than exactly in place need to be evaluated aside
+    Img aside;
+    if (ranges::any_of(images, [&](const Img *img) {
+            return overlaps(*img, out) &&
+                   (img->data() != out.data() || !img->is_sameXYZC(out));
+        }))
+        aside.assign(out.width(), out.height(), out.depth(), out.spectrum());
+    Img &dst = aside ? aside : out;
+
+    const auto run = [&](const unsigned int threads) {
+        kernels::evaluate(program, dst.data(), shape(), threads);
+    };
+    if (dst.size() < kernels::PARALLEL_VALUES) {
+        run(1);
+    }
+    else {
+        nb::gil_scoped_release release;
+        const auto lease = THREADS.acquire(0);
+        run(lease.threads());
+    }
+    if (aside) {
+        copy_n(aside.data(), aside.size(), out.data());
+        STATS.copied(copy_path::IMAGE_COPY, owned_bytes(aside));
+    }
+}
+
+lazy_image_py::Img lazy_image_py::eval() const
+{
+    const auto &s = shape();
+    // Counted as live once returned
+    const auto room = MEMORY.reserve(s[0] * s[1] * s[2] * s[3] * sizeof(T));
+    Img result(s[0], s[1], s[2], s[3]);
+    evaluate(result);
+    return result;
+}
+
+void lazy_image_py::eval_into(Img &out) const
+{
+    COW.detach(out);
+    if (shape_of(out) == shape()) {
+        evaluate(out);
+        return;
+    }
+    if (out.is_shared())
+        throw nb::value_error(
+            ("Output image is a shared view of shape " +
+             shape_to_string(shape_of(out)) +
+             ", which can't be resized to the result's shape " +
+             shape_to_string(shape()))
+                .c_str());
+    // Computed aside, as out may be read by the expression
+    auto result = eval();
+    const auto before = owned_bytes(out);
+    result.move_to(out);
+    STATS.image_resized(before, owned_bytes(out));
+}
+
+void lazy_image_py::bind(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic." << CLASSNAME << " class" << endl);
+    auto cls =
+        nb::class_<lazy_image_py>(
+            m, CLASSNAME,
+            "Deferred result of elementwise operations on images, returned "
+            "by Image.lazy(). Operators on lazy images (with images, lazy "
+            "images or numbers) build an expression instead of computing "
+            "intermediate images, and the whole expression is computed in a "
+            "single pass when evaluated. Images are read at that time")
+            .def_prop_ro(
+                "shape",
+                [](const lazy_image_py &lazy) {
+                    return tuple_cat(lazy.shape());
+                },
+                "Shape of the result, in xyzc order")
+            .def(
+                "eval",
+                [](const lazy_image_py &lazy,
+                   const nb::handle &out) -> nb::object {
+                    if (out.is_none())
+                        return nb::cast(lazy.eval());
+                    lazy.eval_into(nb::cast<Img &>(out));
+                    return nb::borrow(out);
+                },
+                nb::kw_only(), "out"_a = nb::none(),
+                "Computes the expression into out if given (resized if "
+                "needed, it may be one of the expression's images), "
+                "otherwise into a new image")
+            .def(
+                "to_numpy",
+                [](const lazy_image_py &lazy) {
+                    auto *img = new Img(lazy.eval());
+                    nb::capsule owner(img, [](void *p) noexcept {
+                        delete static_cast<Img *>(p);
+                    });
+                    const auto &s = lazy.shape();
+                    const int64_t strides[] = {
+                        1, static_cast<int64_t>(s[0]),
+                        static_cast<int64_t>(s[0] * s[1]),
+                        static_cast<int64_t>(s[0] * s[1] * s[2])};
+                    return nb::ndarray<nb::numpy, T, nb::ndim<4>>(
+                        img->data(), 4, s.data(), owner, strides);
+                },
+                "Computes the expression into a new Numpy NDArray")
+            .def("__neg__",
+                 [](const lazy_image_py &lazy) {
+                     return lazy.combine(kernels::binary_op::SUB,
+                                         *from(nb::int_(0)), true);
+                 })
+            .def("__repr__", [](const lazy_image_py &lazy) {
+                return "<gmic.LazyImage of shape " +
+                       shape_to_string(lazy.shape()) + ">";
+            });
+
+    for (const auto &def : OPERATORS) {
+        const auto combine = [op = def.op](const bool reflected) {
+            return [op, reflected](const lazy_image_py &lazy,
+                                   const nb::handle &other) -> nb::object {
+                const auto operand = from(other);
+                if (!operand)
+                    return nb::borrow(Py_NotImplemented);
+                return nb::cast(lazy.combine(op, *operand, reflected));
+            };
+        };
+        cls.def(def.method, combine(false), "other"_a, def.description);
+        if (def.name) {
+            const string name = def.name;
+            cls.def(("__" + name + "__").c_str(), combine(false), "other"_a);
+            if (def.reflected)
+                cls.def(("__r" + name + "__").c_str(), combine(true),
+                        "other"_a);
+        }
+    }
+}
+
+void bind_lazy_image(nb::module_ &m) { lazy_image_py::bind(m); }
+
+}  // namespace gmicpy
@@ -0,0 +1,76 @@
+#ifndef LAZY_IMAGE_HPP
+#define LAZY_IMAGE_HPP
+#include <map>
+
+#include "gmicpy.hpp"
+#include "kernels.hpp"
+
+namespace gmicpy {
+
+/**
+ * Deferred result of elementwise operations on images. Operators on lazy
+ * images build an expression tree instead of computing full-size
+ * temporaries, and the tree is evaluated in a single blocked pass over
+ * memory (see kernels::evaluate) when it is materialised. Images in the
+ * tree are read at that time, not when operators are applied.
+ */
+class lazy_image_py {
+    using T = gmic_pixel_type;
+    using Img = cimg_library::CImg<T>;
+
+    /// Leaf image or scalar, or operation on two nodes
+    struct node {
+        kernels::shape4 shape;
+        /// Image of a leaf, kept alive by the tree
+        nanobind::object image{};
+        /// Value of a scalar leaf
+        T value = 0;
+        kernels::binary_op op = kernels::binary_op::COUNT;
+        std::shared_ptr<const node> a{}, b{};
+    };
+
+    std::shared_ptr<const node> root;
+
+    explicit lazy_image_py(std::shared_ptr<const node> root)
+        : root(std::move(root))
+    {
+    }
+
+    /// Converts an Image, a LazyImage or a number, if possible
+    static std::optional<lazy_image_py> from(const nanobind::handle &obj);
+
+    /**
+     * Adds the steps computing a node to a program, once per node, and
+     * returns the operand giving its result. Needs the GIL.
+     */
+    static int compile(const node &n, kernels::fused_program<T> &program,
+                       std::vector<const Img *> &images,
+                       std::map<const node *, int> &compiled);
+
+    /// Evaluates the tree into out, which must have its shape
+    void evaluate(Img &out) const;
+
+   public:
+    constexpr static auto CLASSNAME = "LazyImage";
+
+    /// Lazy image reading an Image
+    static lazy_image_py of(const nanobind::handle &img);
+
+    [[nodiscard]] const kernels::shape4 &shape() const { return root->shape; }
+
+    /// Applies an operation, with other as the left operand if reflected
+    [[nodiscard]] lazy_image_py combine(kernels::binary_op op,
+                                        const lazy_image_py &other,
+                                        bool reflected) const;
+
+    [[nodiscard]] Img eval() const;
+
+    /// Evaluates into out, resizing it if needed
+    void eval_into(Img &out) const;
+
+    static void bind(nanobind::module_ &m);
+};
+
+}  // namespace gmicpy
+
+#endif  // LAZY_IMAGE_HPP
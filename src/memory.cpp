@@ -0,0 +1,158 @@
+#include "memory.hpp"
+
+#include <chrono>
+#include <thread>
+
+#include "run_cache.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+
+memory_limit MEMORY;
+
+/// Interval at which blocked allocations check for room again
+static constexpr auto POLL_INTERVAL = chrono::milliseconds(5);
+
+static size_t live_bytes()
+{
+    return static_cast<size_t>(max(STATS.get_live_image_bytes(), int64_t{0}));
+}
+
+[[noreturn]] static void exceeded(const size_t bytes, const size_t limit,
+                                  const size_t reserved)
+{
+    stringstream msg;
+    msg << "Allocating " << bytes << " bytes would exceed the memory limit ("
+        << live_bytes() << " bytes in use and " << reserved << " reserved, of "
+        << limit << ')';
+    throw memory_limit_error(msg.str());
+}
+
+memory_limit::run_usage::run_usage(atomic<size_t> &interpreter_bytes,
+                                   const size_t bytes)
+    : interpreter_bytes(interpreter_bytes), bytes(bytes)
+{
+    interpreter_bytes += bytes;
+    MEMORY.run_bytes += bytes;
+}
+
+memory_limit::run_usage::~run_usage()
+{
+    interpreter_bytes -= bytes;
+    MEMORY.run_bytes -= bytes;
+}
+
+memory_limit::reservation::~reservation() { MEMORY.pending -= bytes; }
+
+void memory_limit::reservation::grow(const size_t total)
+{
+    if (total <= bytes)
+        return;
+    // The image as a whole must fit, not only the room added
+    if (const size_t limit = MEMORY.limit; limit && total > limit)
+        exceeded(total, limit, MEMORY.pending);
+    auto more = MEMORY.reserve(total - bytes);
+    bytes += exchange(more.bytes, 0);
+}
+
+bool memory_limit::try_reserve(const size_t bytes, const size_t limit)
+{
+    if (bytes > limit)
+        return false;
+    size_t reserved = pending;
+    do {
+        if (live_bytes() + reserved > limit - bytes)
+            return false;
+    } while (!pending.compare_exchange_weak(reserved, reserved + bytes));
+    return true;
+}
+
+void memory_limit::set(const size_t limit, const bool blocking,
+                       const int64_t timeout_ms)
+{
+    this->blocking = blocking;
+    this->timeout_ms = timeout_ms;
+    this->limit = limit;
+}
+
+size_t memory_limit::get() const { return limit; }
+
+bool memory_limit::is_blocking() const { return blocking; }
+
+size_t memory_limit::get_run_bytes() const { return run_bytes; }
+
+memory_limit::reservation memory_limit::reserve(const size_t bytes)
+{
+    const size_t limit = this->limit;
+    if (!limit)
+        return {};
+    if (try_reserve(bytes, limit))
+        return reservation(bytes);
+    if (bytes > limit || !blocking)
+        exceeded(bytes, limit, pending);
+
+    // Waits without the GIL, so that other threads may free their images
+    const auto timeout = chrono::milliseconds(timeout_ms.load());
+    const auto deadline = chrono::steady_clock::now() + timeout;
+    optional<nb::gil_scoped_release> release;
+    if (PyGILState_Check())
+        release.emplace();
+    while (!try_reserve(bytes, limit)) {
+        if (timeout.count() >= 0 && chrono::steady_clock::now() >= deadline)
+            exceeded(bytes, limit, pending);
+        this_thread::sleep_for(POLL_INTERVAL);
+    }
+    return reservation(bytes);
+}
+
+static nb::dict memory_info()
+{
+    nb::dict info{};
+    info["images"] = live_bytes();
+    info["runs"] = MEMORY.get_run_bytes();
+    info["run_cache"] = RUN_CACHE.get_used();
+    if (const auto limit = MEMORY.get())
+        info["limit"] = limit;
+    else
+        info["limit"] = nb::none();
+    info["blocking"] = MEMORY.is_blocking();
+    return info;
+}
+
+void bind_memory(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic memory functions" << endl);
+    nb::exception<memory_limit_error>(  // NOLINT(*-throw-keyword-missing)
+        m, "MemoryLimitError", PyExc_MemoryError);
+    m.def("memory_info", &memory_info,
+          "Returns the memory held by the module as a dict:\n"
+          "- images: bytes of the buffers owned by live images and lists\n"
+          "- runs: bytes of the images that runs in progress work on "
+          "(already counted in images, see Gmic.run_bytes)\n"
+          "- run_cache: bytes held by the cache of run outputs\n"
+          "- limit: the soft limit on images set by gmic.set_memory_limit(), "
+          "or None\n"
+          "- blocking: whether going over it waits instead of raising");
+    m.def(
+        "set_memory_limit",
+        [](const size_t bytes, const bool block,
+           const optional<double> timeout) {
+            MEMORY.set(bytes, block,
+                       timeout ? static_cast<int64_t>(*timeout * 1000) : -1);
+        },
+        "bytes"_a, nb::kw_only(), "block"_a = false,
+        "timeout"_a = nb::none(),
+        "Sets a process-wide soft limit on the bytes of live images (0 "
+        "removes it). Creating or assigning images (from dimensions, arrays, "
+        "files, batches or copies), decoding images and starting runs then "
+        "raise gmic.MemoryLimitError (a MemoryError) if the images wouldn't "
+        "fit under it, along with the images other threads are allocating, "
+        "or, if block is set, wait for other threads to free enough images, "
+        "for up to timeout seconds (forever if None). The memory G'MIC "
+        "allocates during runs isn't limited, only runs starting over the "
+        "limit are");
+}
+
+}  // namespace gmicpy
@@ -0,0 +1,107 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+
+#include "gmicpy.hpp"
+
+namespace gmicpy {
+
+/// Raised (as gmic.MemoryLimitError) when the soft memory limit is reached
+class memory_limit_error : public std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * Process-wide soft limit on the bytes of live images (STATS' gauge, which
+ * includes the images runs work on). The bindings reserve room for images
+ * before allocating them when their size is known (dimensions, arrays,
+ * batches, copies, operator results, encoded images with the dimensions in
+ * their header), and once allocated otherwise (files), until they are
+ * counted as live. Runs are only held back before they
+ * start, as their own allocations happen inside G'MIC and can't be
+ * limited. Depending on the mode, going over the limit raises, or waits
+ * for other threads to free images.
+ */
+class memory_limit {
+    std::atomic<size_t> limit = 0;
+    std::atomic<bool> blocking = false;
+    /// Longest wait in blocking mode, negative to wait forever
+    std::atomic<int64_t> timeout_ms = -1;
+    std::atomic<size_t> run_bytes = 0;
+    /// Bytes reserved for images not counted as live yet
+    std::atomic<size_t> pending = 0;
+
+    /**
+     * Adds bytes to the pending ones if they fit under limit along with
+     * the live and pending ones
+     */
+    [[nodiscard]] bool try_reserve(size_t bytes, size_t limit);
+
+   public:
+    /// Images held by a run, accounted for while it is in progress
+    class run_usage {
+        std::atomic<size_t> &interpreter_bytes;
+        const size_t bytes;
+
+       public:
+        run_usage(std::atomic<size_t> &interpreter_bytes, size_t bytes);
+        run_usage(const run_usage &) = delete;
+        run_usage &operator=(const run_usage &) = delete;
+        ~run_usage();
+    };
+
+    /**
+     * Room reserved under the limit for an image, until it is destroyed:
+     * once the image is counted as live, or its allocation failed
+     */
+    class reservation {
+        friend class memory_limit;
+        size_t bytes = 0;
+
+        explicit reservation(size_t bytes) : bytes(bytes) {}
+
+       public:
+        reservation() = default;
+        reservation(reservation &&other) noexcept
+            : bytes(std::exchange(other.bytes, 0))
+        {
+        }
+        reservation &operator=(reservation &&) = delete;
+        ~reservation();
+
+        /**
+         * Reserves more room if needed, so that total bytes are reserved,
+         * for images whose size is only known once allocated. Throws or
+         * waits like memory_limit::reserve().
+         */
+        void grow(size_t total);
+    };
+
+    /**
+     * @param limit Maximum number of live bytes, 0 for no limit
+     * @param blocking Whether to wait for room instead of raising
+     * @param timeout_ms Longest wait, negative to wait forever
+     */
+    void set(size_t limit, bool blocking, int64_t timeout_ms);
+    [[nodiscard]] size_t get() const;
+    [[nodiscard]] bool is_blocking() const;
+    [[nodiscard]] size_t get_run_bytes() const;
+
+    /**
+     * Reserves room for bytes more: returns once they fit under the limit,
+     * along with the live images and the other reservations, waiting for
+     * them to (without the GIL, if held) in blocking mode, or throws
+     * memory_limit_error. Allocations larger than the limit itself always
+     * throw. Nothing is reserved while there is no limit.
+     */
+    reservation reserve(size_t bytes);
+};
+
+extern memory_limit MEMORY;
+
+}  // namespace gmicpy
+
+#endif  // MEMORY_HPP
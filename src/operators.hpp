@@ -0,0 +1,63 @@
+#ifndef OPERATORS_HPP
+#define OPERATORS_HPP
+#include "kernels.hpp"
+
+namespace gmicpy {
+
+/// Python names of an elementwise operation
+struct operator_def {
+    kernels::binary_op op;
+    /// Operator name without underscores, null for methods only
+    const char *name;
+    /// Name of the equivalent method, as in numpy
+    const char *method;
+    const char *description;
+    /// Whether the operator has reflected and in-place variants
+    bool reflected;
+};
+
+/// Elementwise operations bound on Image and LazyImage
+inline constexpr operator_def OPERATORS[] = {
+    {kernels::binary_op::ADD, "add", "add", "Adds other to the image", true},
+    {kernels::binary_op::SUB, "sub", "subtract",
+     "Subtracts other from the image", true},
+    {kernels::binary_op::MUL, "mul", "multiply",
+     "Multiplies the image by other", true},
+    {kernels::binary_op::DIV, "truediv", "divide",
+     "Divides the image by other", true},
+    {kernels::binary_op::FLOOR_DIV, "floordiv", "floor_divide",
+     "Divides the image by other, rounding down", true},
+    {kernels::binary_op::MOD, "mod", "mod",
+     "Remainder of the division of the image by other, of the sign of "
+     "other",
+     true},
+    {kernels::binary_op::POW, "pow", "power",
+     "Raises the image to the power other", true},
+    {kernels::binary_op::AND, "and", "bitwise_and",
+     "Bitwise and of the integer parts of the image and other", true},
+    {kernels::binary_op::OR, "or", "bitwise_or",
+     "Bitwise or of the integer parts of the image and other", true},
+    {kernels::binary_op::XOR, "xor", "bitwise_xor",
+     "Bitwise xor of the integer parts of the image and other", true},
+    {kernels::binary_op::LT, "lt", "less",
+     "1 where the image is < other, 0 elsewhere", false},
+    {kernels::binary_op::LE, "le", "less_equal",
+     "1 where the image is <= other, 0 elsewhere", false},
+    {kernels::binary_op::GT, "gt", "greater",
+     "1 where the image is > other, 0 elsewhere", false},
+    {kernels::binary_op::GE, "ge", "greater_equal",
+     "1 where the image is >= other, 0 elsewhere", false},
+    // == and != compare whole images
+    {kernels::binary_op::EQ, nullptr, "equal",
+     "1 where the image is equal to other, 0 elsewhere", false},
+    {kernels::binary_op::NE, nullptr, "not_equal",
+     "1 where the image differs from other, 0 elsewhere", false},
+    {kernels::binary_op::MIN, nullptr, "minimum",
+     "Smallest of the image and other, at each point", false},
+    {kernels::binary_op::MAX, nullptr, "maximum",
+     "Largest of the image and other, at each point", false},
+};
+
+}  // namespace gmicpy
+
+#endif  // OPERATORS_HPP
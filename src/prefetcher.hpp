@@ -0,0 +1,130 @@
+#ifndef PREFETCHER_HPP
+#define PREFETCHER_HPP
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace gmicpy {
+
+/**
+ * Runs a fixed number of indexed tasks on background threads and hands
+ * their results out in index order. At most window results are in flight
+ * or waiting to be taken at any time, which bounds memory use when the
+ * consumer is slower than the workers. Exceptions thrown by a task are
+ * rethrown by next() when its turn comes.
+ *
+ * Workers never touch Python: callers should release the GIL around
+ * next(), which may block.
+ */
+template <class R>
+class ordered_prefetcher {
+    struct result {
+        R value{};
+        std::exception_ptr error{};
+    };
+
+    const std::function<R(size_t)> task;
+    const size_t count;
+    const size_t window;
+    std::mutex mtx;
+    std::condition_variable has_result, has_room;
+    std::map<size_t, result> results;
+    size_t next_task = 0, next_result = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    void work()
+    {
+        std::unique_lock lock(mtx);
+        while (true) {
+            has_room.wait(lock, [this] {
+                return stopping || next_task >= count ||
+                       next_task - next_result < window;
+            });
+            if (stopping || next_task >= count)
+                return;
+            const size_t i = next_task++;
+            lock.unlock();
+            result res;
+            try {
+                res.value = task(i);
+            }
+            catch (...) {
+                res.error = std::current_exception();
+            }
+            lock.lock();
+            results.emplace(i, std::move(res));
+            has_result.notify_all();
+        }
+    }
+
+   public:
+    /**
+     * @param count Number of tasks
+     * @param task Function computing the result of the given task
+     * @param window Maximum number of results in flight or pending
+     * @param threads Number of worker threads (0 for one per window slot,
+     * up to the CPU count)
+     */
+    ordered_prefetcher(const size_t count, std::function<R(size_t)> task,
+                       const size_t window, unsigned int threads = 0)
+        : task(std::move(task)),
+          count(count),
+          window(std::max<size_t>(window, 1))
+    {
+        if (threads == 0)
+            threads = static_cast<unsigned int>(
+                std::min<size_t>(this->window,
+                                 std::max(std::thread::hardware_concurrency(),
+                                          1U)));
+        threads = static_cast<unsigned int>(std::min<size_t>(threads, count));
+        workers.reserve(threads);
+        for (unsigned int i = 0; i < threads; i++)
+            workers.emplace_back(&ordered_prefetcher::work, this);
+    }
+
+    ordered_prefetcher(const ordered_prefetcher &) = delete;
+    ordered_prefetcher &operator=(const ordered_prefetcher &) = delete;
+
+    ~ordered_prefetcher()
+    {
+        {
+            std::lock_guard lock(mtx);
+            stopping = true;
+        }
+        has_room.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    [[nodiscard]] size_t size() const { return count; }
+
+    /**
+     * Waits for the result of the next task and returns it, or rethrows
+     * its exception. Returns nothing once all results were taken.
+     */
+    std::optional<R> next()
+    {
+        std::unique_lock lock(mtx);
+        if (next_result >= count)
+            return {};
+        has_result.wait(lock,
+                        [this] { return results.contains(next_result); });
+        auto node = results.extract(next_result++);
+        lock.unlock();
+        has_room.notify_all();
+        if (node.mapped().error)
+            std::rethrow_exception(node.mapped().error);
+        return std::move(node.mapped().value);
+    }
+};
+
+}  // namespace gmicpy
+
+#endif  // PREFETCHER_HPP
@@ -0,0 +1,265 @@
+#include "reductions.hpp"
+
+#include "kernels.hpp"
+#include "utils.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace std;
+using namespace cimg_library;
+
+using Img = CImg<gmic_pixel_type>;
+
+static size_t axis_index(const nb::handle &axis)
+{
+    if (nb::isinstance<nb::str>(axis)) {
+        const auto name = nb::cast<string>(axis);
+        const auto pos = string_view("xyzc").find(name);
+        if (name.size() != 1 || pos == string_view::npos)
+            throw nb::value_error(
+                ("Unknown axis '" + name + "', expected x, y, z or c")
+                    .c_str());
+        return pos;
+    }
+    long index;
+    if (!nb::try_cast(axis, index))
+        throw nb::type_error("Axes must be given as indices or letters");
+    if (index < -4 || index > 3)
+        throw nb::value_error(
+            ("Axis " + to_string(index) + " is out of bounds").c_str());
+    return static_cast<size_t>(index < 0 ? index + 4 : index);
+}
+
+array<bool, 4> parse_axes(const nb::handle &axis)
+{
+    array<bool, 4> reduced{};
+    if (axis.is_none()) {
+        reduced.fill(true);
+        return reduced;
+    }
+    const auto add = [&](const nb::handle &a) {
+        const auto index = axis_index(a);
+        if (reduced[index])
+            throw nb::value_error(
+                ("Axis '" + string(1, "xyzc"[index]) + "' is repeated")
+                    .c_str());
+        reduced[index] = true;
+    };
+    if (nb::isinstance<nb::str>(axis)) {
+        for (const char c : nb::cast<string>(axis))
+            add(nb::str(&c, 1));
+    }
+    else if (nb::isinstance<nb::sequence>(axis)) {
+        for (const auto a : axis)
+            add(a);
+    }
+    else {
+        add(axis);
+    }
+    return reduced;
+}
+
+static kernels::shape4 shape_of(const Img &img)
+{
+    if (!img.data())
+        throw runtime_error("Image has no data");
+    return {img._width, img._height, img._depth, img._spectrum};
+}
+
+/**
+ * Calls f(threads) with the GIL released and threads leased from the
+ * budget, if there are enough values for threads to be worth it
+ */
+template <class F>
+static auto with_threads(const size_t values, F f)
+{
+    if (values < kernels::PARALLEL_VALUES)
+        return f(1U);
+    nb::gil_scoped_release release;
+    const auto lease = THREADS.acquire(0);
+    return f(lease.threads());
+}
+
+static nb::dict to_dict(const vector<kernels::summary> &summaries,
+                        const kernels::shape4 &shape,
+                        const array<bool, 4> &reduced)
+{
+    using field = double (*)(const kernels::summary &);
+    static constexpr pair<const char *, field> FIELDS[] = {
+        {"min", [](const kernels::summary &s) { return s.min; }},
+        {"max", [](const kernels::summary &s) { return s.max; }},
+        {"sum", [](const kernels::summary &s) { return s.sum; }},
+        {"mean", [](const kernels::summary &s) { return s.mean; }},
+        {"variance",
+         [](const kernels::summary &s) {
+             return s.m2 / static_cast<double>(s.count);
+         }},
+    };
+
+    nb::dict stats;
+    const bool all = ranges::all_of(reduced, [](const bool r) { return r; });
+    // Planar arrays of the image's shape, with reduced axes of size 1
+    array<size_t, 4> kept{};
+    array<int64_t, 4> strides{};
+    int64_t stride = 1;
+    for (size_t axis = 0; axis < 4; axis++) {
+        kept[axis] = reduced[axis] ? 1 : shape[axis];
+        strides[axis] = stride;
+        stride *= static_cast<int64_t>(kept[axis]);
+    }
+    for (const auto &[name, get] : FIELDS) {
+        if (all) {
+            stats[name] = get(summaries[0]);
+            continue;
+        }
+        auto *data = new double[summaries.size()];
+        nb::capsule owner(data, [](void *p) noexcept {
+            delete[] static_cast<double *>(p);
+        });
+        ranges::transform(summaries, data, get);
+        stats[name] = nb::ndarray<nb::numpy, double>(data, 4, kept.data(),
+                                                     owner, strides.data());
+    }
+    return stats;
+}
+
+nb::dict image_stats(const Img &img, const nb::handle &axis)
+{
+    const auto reduced = parse_axes(axis);
+    const auto shape = shape_of(img);
+    const auto summaries =
+        with_threads(img.size(), [&](const unsigned int threads) {
+            return kernels::summarize(img.data(), shape, reduced, threads);
+        });
+    return to_dict(summaries, shape, reduced);
+}
+
+nb::list list_stats(const CImgList<gmic_pixel_type> &list,
+                    const nb::handle &axis)
+{
+    const auto reduced = parse_axes(axis);
+    vector<kernels::shape4> shapes;
+    size_t values = 0;
+    for (const auto &img : list) {
+        shapes.push_back(shape_of(img));
+        values += img.size();
+    }
+    const auto summaries =
+        with_threads(values, [&](const unsigned int threads) {
+            vector<vector<kernels::summary>> all;
+            for (unsigned int i = 0; i < list.size(); i++)
+                all.push_back(kernels::summarize(list[i].data(), shapes[i],
+                                                 reduced, threads));
+            return all;
+        });
+    nb::list result;
+    for (size_t i = 0; i < summaries.size(); i++)
+        result.append(to_dict(summaries[i], shapes[i], reduced));
+    return result;
+}
+
+nb::ndarray<nb::numpy, int64_t> image_histogram(
+    const Img &img, const size_t bins,
+    const optional<tuple<double, double>> &range)
+{
+    shape_of(img);
+    if (!bins)
+        throw nb::value_error("Number of bins must be positive");
+    if (range) {
+        const auto [min, max] = *range;
+        if (!isfinite(min) || !isfinite(max) || min > max)
+            throw nb::value_error(
+                "Range must be finite, with min lower than max");
+    }
+
+    auto *counts = new int64_t[bins];
+    nb::capsule owner(counts, [](void *p) noexcept {
+        delete[] static_cast<int64_t *>(p);
+    });
+    with_threads(img.size(), [&](const unsigned int threads) {
+        double min, max;
+        if (range) {
+            tie(min, max) = *range;
+        }
+        else {
+            const auto all = kernels::summarize(
+                img.data(), shape_of(img), {true, true, true, true}, threads);
+            min = all[0].min;
+            max = all[0].max;
+            if (!isfinite(min) || !isfinite(max))
+                throw nb::value_error(
+                    "Image values aren't all finite, a range must be given");
+        }
+        // Same as numpy, for ranges reduced to a single value
+        if (min == max) {
+            min -= 0.5;
+            max += 0.5;
+        }
+        kernels::histogram(img.data(), img.size(), min, max, counts, bins,
+                           threads);
+        return 0;
+    });
+    return nb::ndarray<nb::numpy, int64_t>(counts, {bins}, owner);
+}
+
+static kernels::hash_algorithm parse_algorithm(const string_view algorithm)
+{
+    if (algorithm == "xxh3")
+        return kernels::hash_algorithm::XXH3;
+    if (algorithm == "xxh64")
+        return kernels::hash_algorithm::XXH64;
+    throw nb::value_error(("Unsupported digest algorithm '" +
+                           string(algorithm) + "', expected 'xxh3' or 'xxh64'")
+                              .c_str());
+}
+
+/// Digest of an image, which must have data, without the GIL
+static uint64_t digest(const kernels::hash_algorithm algorithm,
+                       const Img &img, const unsigned int threads)
+{
+    const array<uint64_t, 4> header{img._width, img._height, img._depth,
+                                    img._spectrum};
+    return kernels::tree_digest(algorithm, header.data(), sizeof(header),
+                                img.data(),
+                                img.size() * sizeof(gmic_pixel_type),
+                                threads);
+}
+
+static nb::bytes to_bytes(const uint64_t digest)
+{
+    array<char, 8> bytes{};
+    for (size_t i = 0; i < bytes.size(); i++)
+        bytes[i] = static_cast<char>(digest >> (56 - 8 * i));
+    return nb::bytes(bytes.data(), bytes.size());
+}
+
+nb::bytes image_digest(const Img &img, const string_view algorithm)
+{
+    const auto hash = parse_algorithm(algorithm);
+    shape_of(img);
+    return to_bytes(
+        with_threads(img.size(), [&](const unsigned int threads) {
+            return digest(hash, img, threads);
+        }));
+}
+
+nb::bytes list_digest(const CImgList<gmic_pixel_type> &list,
+                      const string_view algorithm)
+{
+    const auto hash = parse_algorithm(algorithm);
+    size_t values = 0;
+    for (const auto &img : list) {
+        shape_of(img);
+        values += img.size();
+    }
+    return to_bytes(with_threads(values, [&](const unsigned int threads) {
+        // Number of images, then their digests
+        vector<uint64_t> digests = {list.size()};
+        for (unsigned int i = 0; i < list.size(); i++)
+            digests.push_back(digest(hash, list[i], threads));
+        return kernels::hash(hash, digests.data(),
+                             digests.size() * sizeof(uint64_t));
+    }));
+}
+
+}  // namespace gmicpy
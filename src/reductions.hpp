@@ -0,0 +1,51 @@
+#ifndef REDUCTIONS_HPP
+#define REDUCTIONS_HPP
+#include "gmicpy.hpp"
+
+namespace gmicpy {
+
+/**
+ * Parses the axes reduced by a statistic: None for all axes, an axis index
+ * (0 to 3, or -4 to -1) or letter ('x', 'y', 'z' or 'c'), a string of
+ * letters such as "xyz", or a sequence of indices or letters.
+ */
+std::array<bool, 4> parse_axes(const nanobind::handle &axis);
+
+/**
+ * Min, max, sum, mean and (population) variance of an image over the given
+ * axes, as a dict. Values are floats when all axes are reduced, otherwise
+ * float64 arrays of the image's shape with the reduced axes of size 1.
+ * Computed with the GIL released for large images.
+ */
+nanobind::dict image_stats(const cimg_library::CImg<gmic_pixel_type> &img,
+                           const nanobind::handle &axis);
+
+/// Statistics of each image of a list, as for image_stats
+nanobind::list list_stats(
+    const cimg_library::CImgList<gmic_pixel_type> &list,
+    const nanobind::handle &axis);
+
+/**
+ * Counts of the values of an image in bins equal intervals of range (the
+ * image's min and max if not given), as an int64 array
+ */
+nanobind::ndarray<nanobind::numpy, int64_t> image_histogram(
+    const cimg_library::CImg<gmic_pixel_type> &img, size_t bins,
+    const std::optional<std::tuple<double, double>> &range);
+
+/**
+ * Digest of the dimensions and (bitwise) values of an image, as the 8 bytes
+ * of its big-endian representation. The algorithm is "xxh3" or "xxh64".
+ * Computed with the GIL released for large images.
+ */
+nanobind::bytes image_digest(const cimg_library::CImg<gmic_pixel_type> &img,
+                             std::string_view algorithm);
+
+/// Digest of the number of images of a list and of their digests
+nanobind::bytes list_digest(
+    const cimg_library::CImgList<gmic_pixel_type> &list,
+    std::string_view algorithm);
+
+}  // namespace gmicpy
+
+#endif  // REDUCTIONS_HPP
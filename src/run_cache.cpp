@@ -0,0 +1,150 @@
+#include "run_cache.hpp"
+
+#include "kernels.hpp"
+#include "utils.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+using namespace cimg_library;
+
+run_cache RUN_CACHE{size_t{256} << 20};
+
+run_cache::run_cache(const size_t capacity) : capacity(capacity) {}
+
+string run_cache::make_key(
+    const string_view cmd,
+    const vector<shared_ptr<command_library>> &libraries,
+    const CImgList<T> &images, const CImgList<char> &names,
+    const unsigned int threads)
+{
+    // The command, then fixed-size fields, so that keys can't be ambiguous
+    string key(cmd);
+    key.push_back('\0');
+    const auto append = [&](const uint64_t value) {
+        key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    append(gmic_version);
+    append(libraries.size());
+    for (const auto &lib : libraries)
+        append(lib->get_version());
+    append(images.size());
+    for (const auto &img : images) {
+        const array<uint64_t, 4> dims{img._width, img._height, img._depth,
+                                      img._spectrum};
+        append(kernels::tree_digest(kernels::hash_algorithm::XXH3,
+                                    dims.data(), sizeof(dims), img.data(),
+                                    img.size() * sizeof(T), threads));
+    }
+    append(names.size());
+    for (const auto &name : names)
+        append(kernels::hash(kernels::hash_algorithm::XXH3, name.data(),
+                             name.size()));
+    return key;
+}
+
+bool run_cache::restore(const string &key, CImgList<T> &images,
+                        CImgList<char> &names)
+{
+    shared_ptr<const entry> found;
+    {
+        lock_guard lock(mtx);
+        const auto it = index.find(key);
+        if (it == index.end()) {
+            STATS.run_cache_missed();
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        found = *it->second;
+    }
+    // Copied without holding the lock, the entry being immutable. Swapped
+    // in, as inputs may be shared images whose size can't change
+    STATS.run_cache_hit();
+    CImgList<T>(found->images, false).swap(images);
+    CImgList<char>(found->names, false).swap(names);
+    STATS.copied(copy_path::RUN_CACHE, owned_bytes(images));
+    return true;
+}
+
+void run_cache::make_room(const size_t bytes)
+{
+    while (!entries.empty() && used + bytes > capacity) {
+        const auto &last = entries.back();
+        used -= last->bytes;
+        STATS.run_cache_evicted(last->bytes);
+        index.erase(last->key);
+        entries.pop_back();
+    }
+}
+
+void run_cache::store(string key, const CImgList<T> &images,
+                      const CImgList<char> &names)
+{
+    const size_t bytes = owned_bytes(images) + owned_bytes(names);
+    {
+        lock_guard lock(mtx);
+        if (bytes > capacity || index.contains(key))
+            return;
+    }
+    auto copy = make_shared<entry>(entry{std::move(key), {}, {}, bytes});
+    copy->images.assign(images);
+    copy->names.assign(names);
+    STATS.copied(copy_path::RUN_CACHE, owned_bytes(copy->images));
+
+    lock_guard lock(mtx);
+    // Checked again, as the lock was released while copying
+    if (bytes > capacity || index.contains(copy->key))
+        return;
+    make_room(bytes);
+    entries.push_front(std::move(copy));
+    index.emplace(entries.front()->key, entries.begin());
+    used += bytes;
+}
+
+void run_cache::set_capacity(const size_t capacity)
+{
+    lock_guard lock(mtx);
+    this->capacity = capacity;
+    make_room(0);
+}
+
+size_t run_cache::get_capacity() const
+{
+    lock_guard lock(mtx);
+    return capacity;
+}
+
+size_t run_cache::get_used() const
+{
+    lock_guard lock(mtx);
+    return used;
+}
+
+void run_cache::clear()
+{
+    lock_guard lock(mtx);
+    entries.clear();
+    index.clear();
+    used = 0;
+}
+
+void bind_run_cache(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic run cache functions" << endl);
+    m.def(
+        "set_run_cache_size",
+        [](const size_t bytes) { RUN_CACHE.set_capacity(bytes); }, "bytes"_a,
+        "Sets the maximum number of bytes of images and names held by the "
+        "cache of run outputs (256 MiB by default, 0 disables it), evicting "
+        "least recently used outputs if needed");
+    m.def(
+        "get_run_cache_size", [] { return RUN_CACHE.get_capacity(); },
+        "Returns the maximum number of bytes held by the cache of run "
+        "outputs");
+    m.def(
+        "clear_run_cache", [] { RUN_CACHE.clear(); },
+        "Drops every output held by the cache of run outputs");
+}
+
+}  // namespace gmicpy
@@ -0,0 +1,69 @@
+#ifndef RUN_CACHE_HPP
+#define RUN_CACHE_HPP
+#include <list>
+
+#include "command_library.hpp"
+
+namespace gmicpy {
+
+/**
+ * Process-wide LRU cache of the outputs of G'MIC runs, bounded by the bytes
+ * of images and names it holds. Runs opt in explicitly, as only commands
+ * whose output depends on nothing but their inputs (no randomness, files,
+ * or interpreter variables set by previous runs) may be cached.
+ */
+class run_cache {
+    using T = gmic_pixel_type;
+
+    struct entry {
+        std::string key;
+        cimg_library::CImgList<T> images;
+        cimg_library::CImgList<char> names;
+        size_t bytes;
+    };
+
+    mutable std::mutex mtx;
+    /// Most recently used first
+    std::list<std::shared_ptr<const entry>> entries;
+    std::unordered_map<std::string,
+                       std::list<std::shared_ptr<const entry>>::iterator>
+        index;
+    size_t capacity, used = 0;
+
+    /// Evicts least recently used entries until used + bytes <= capacity
+    void make_room(size_t bytes);
+
+   public:
+    /// @param capacity Maximum number of bytes held, 0 to disable caching
+    explicit run_cache(size_t capacity);
+
+    /**
+     * Key of a run: its command, the versions of G'MIC and of the attached
+     * libraries, and digests of the input images and names. Hashes the
+     * images on up to threads threads.
+     */
+    static std::string make_key(
+        std::string_view cmd,
+        const std::vector<std::shared_ptr<command_library>> &libraries,
+        const cimg_library::CImgList<T> &images,
+        const cimg_library::CImgList<char> &names, unsigned int threads);
+
+    /// Replaces images and names by copies of a cached output, if any
+    bool restore(const std::string &key, cimg_library::CImgList<T> &images,
+                 cimg_library::CImgList<char> &names);
+
+    /// Caches a copy of the output of a run, unless it exceeds the capacity
+    void store(std::string key, const cimg_library::CImgList<T> &images,
+               const cimg_library::CImgList<char> &names);
+
+    void set_capacity(size_t capacity);
+    [[nodiscard]] size_t get_capacity() const;
+    [[nodiscard]] size_t get_used() const;
+    void clear();
+};
+
+extern run_cache RUN_CACHE;
+
+}  // namespace gmicpy
+
+#endif  // RUN_CACHE_HPP
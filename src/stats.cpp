@@ -0,0 +1,68 @@
+#include "stats.hpp"
+
+#include "gmicpy.hpp"
+#include "run_cache.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+
+runtime_stats STATS{};
+
+static nb::dict get_stats()
+{
+    nb::dict copies{};
+    for (size_t i = 0; i < runtime_stats::COPY_PATHS; ++i)
+        copies[runtime_stats::COPY_PATH_NAMES[i]] = STATS.get_bytes_copied(i);
+
+    nb::list hist{};
+    for (size_t i = 0; i < runtime_stats::RUN_TIME_BUCKETS; ++i) {
+        const double bound =
+            i + 1 < runtime_stats::RUN_TIME_BUCKETS
+                ? static_cast<double>(uint64_t{1} << i) * 1e-6
+                : numeric_limits<double>::infinity();
+        hist.append(nb::make_tuple(bound, STATS.get_run_time_hist(i)));
+    }
+
+    nb::dict stats{};
+    stats["bytes_copied"] = copies;
+    stats["images_allocated"] = STATS.get_images_allocated();
+    stats["images_freed"] = STATS.get_images_freed();
+    stats["live_image_bytes"] = STATS.get_live_image_bytes();
+    stats["runs"] = STATS.get_runs();
+    stats["run_time"] = static_cast<double>(STATS.get_run_time_ns()) * 1e-9;
+    stats["run_time_histogram"] = hist;
+
+    nb::dict cache{};
+    cache["hits"] = STATS.get_run_cache_hits();
+    cache["misses"] = STATS.get_run_cache_misses();
+    cache["evicted_bytes"] = STATS.get_run_cache_evicted_bytes();
+    cache["bytes"] = RUN_CACHE.get_used();
+    cache["capacity"] = RUN_CACHE.get_capacity();
+    stats["run_cache"] = cache;
+    return stats;
+}
+
+void bind_stats(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic.stats functions" << endl);
+    m.def("stats", &get_stats,
+          "Returns the runtime counters of the module as a dict:\n"
+          "- bytes_copied: bytes of pixel data copied, per conversion path\n"
+          "- images_allocated, images_freed: number of image buffers "
+          "created and released by the bindings\n"
+          "- live_image_bytes: bytes currently held by those images\n"
+          "- runs, run_time: number of G'MIC runs and their total wall "
+          "time in seconds\n"
+          "- run_time_histogram: list of (upper bound in seconds, count) "
+          "buckets of run wall times\n"
+          "- run_cache: hits, misses and evicted_bytes of the cache of run "
+          "outputs, and the bytes it holds out of its capacity");
+    m.def(
+        "reset_stats", [] { STATS.reset(); },
+        "Resets the counters returned by gmic.stats(), except "
+        "live_image_bytes");
+}
+
+}  // namespace gmicpy
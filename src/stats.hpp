@@ -0,0 +1,169 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+
+namespace gmicpy {
+
+/// Conversion paths whose data copies are accounted for by runtime_stats
+enum class copy_path : uint8_t {
+    NDARRAY_TO_IMAGE,
+    IMAGE_TO_NDARRAY,
+    YXC_TO_IMAGE,
+    IMAGE_TO_YXC,
+    IMAGE_COPY,
+    LIST_ITEM,
+    RUN_CACHE,
+    COUNT
+};
+
+/**
+ * Always-on runtime counters, readable from Python through gmic.stats().
+ * Every update is a single relaxed atomic operation so that counting stays
+ * cheap enough to be left enabled in release builds.
+ */
+class runtime_stats {
+   public:
+    static constexpr size_t COPY_PATHS = static_cast<size_t>(copy_path::COUNT);
+    static constexpr const char *COPY_PATH_NAMES[COPY_PATHS] = {
+        "ndarray_to_image", "image_to_ndarray", "yxc_to_image",
+        "image_to_yxc",     "image_copy",       "list_item",
+        "run_cache"};
+    /// Bucket i counts runs that took less than 2^i µs (last one is open)
+    static constexpr size_t RUN_TIME_BUCKETS = 32;
+
+    using counter = std::atomic<uint64_t>;
+
+   private:
+    std::array<counter, COPY_PATHS> bytes_copied{};
+    counter images_allocated{}, images_freed{};
+    std::atomic<int64_t> live_image_bytes{};
+    counter runs{}, run_time_ns{};
+    std::array<counter, RUN_TIME_BUCKETS> run_time_hist{};
+    counter cache_hits{}, cache_misses{}, cache_evicted_bytes{};
+
+    static void add(counter &c, const uint64_t v = 1) noexcept
+    {
+        c.fetch_add(v, std::memory_order_relaxed);
+    }
+
+   public:
+    void copied(const copy_path path, const size_t bytes) noexcept
+    {
+        add(bytes_copied[static_cast<size_t>(path)], bytes);
+    }
+
+    void image_allocated(const size_t bytes, const size_t count = 1) noexcept
+    {
+        add(images_allocated, count);
+        live_image_bytes.fetch_add(static_cast<int64_t>(bytes),
+                                   std::memory_order_relaxed);
+    }
+
+    void image_freed(const size_t bytes, const size_t count = 1) noexcept
+    {
+        add(images_freed, count);
+        live_image_bytes.fetch_sub(static_cast<int64_t>(bytes),
+                                   std::memory_order_relaxed);
+    }
+
+    /// Accounts for an in-place reallocation of an already counted image
+    void image_resized(const size_t from, const size_t to) noexcept
+    {
+        if (from != to)
+            live_image_bytes.fetch_add(
+                static_cast<int64_t>(to) - static_cast<int64_t>(from),
+                std::memory_order_relaxed);
+    }
+
+    void run_done(const std::chrono::nanoseconds duration) noexcept
+    {
+        const auto ns = static_cast<uint64_t>(duration.count());
+        add(runs);
+        add(run_time_ns, ns);
+        const auto bucket = std::bit_width(ns / 1000);
+        add(run_time_hist[bucket < RUN_TIME_BUCKETS ? bucket
+                                                    : RUN_TIME_BUCKETS - 1]);
+    }
+
+    void run_cache_hit() noexcept { add(cache_hits); }
+    void run_cache_missed() noexcept { add(cache_misses); }
+    void run_cache_evicted(const size_t bytes) noexcept
+    {
+        add(cache_evicted_bytes, bytes);
+    }
+
+    /// Resets every counter, except live_image_bytes which is a gauge
+    void reset() noexcept
+    {
+        for (auto &c : bytes_copied)
+            c.store(0, std::memory_order_relaxed);
+        for (auto &c : run_time_hist)
+            c.store(0, std::memory_order_relaxed);
+        for (auto *c : {&images_allocated, &images_freed, &runs, &run_time_ns,
+                        &cache_hits, &cache_misses, &cache_evicted_bytes})
+            c->store(0, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t get_bytes_copied(const size_t path) const noexcept
+    {
+        return bytes_copied[path].load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t get_images_allocated() const noexcept
+    {
+        return images_allocated.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t get_images_freed() const noexcept
+    {
+        return images_freed.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] int64_t get_live_image_bytes() const noexcept
+    {
+        return live_image_bytes.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t get_runs() const noexcept
+    {
+        return runs.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t get_run_time_ns() const noexcept
+    {
+        return run_time_ns.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t get_run_time_hist(const size_t i) const noexcept
+    {
+        return run_time_hist[i].load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t get_run_cache_hits() const noexcept
+    {
+        return cache_hits.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t get_run_cache_misses() const noexcept
+    {
+        return cache_misses.load(std::memory_order_relaxed);
+    }
+    [[nodiscard]] uint64_t get_run_cache_evicted_bytes() const noexcept
+    {
+        return cache_evicted_bytes.load(std::memory_order_relaxed);
+    }
+};
+
+extern runtime_stats STATS;
+
+/// Records the wall time of a G'MIC run in STATS when going out of scope
+class run_timer {
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+   public:
+    run_timer() = default;
+    run_timer(const run_timer &) = delete;
+    run_timer &operator=(const run_timer &) = delete;
+    ~run_timer() { STATS.run_done(std::chrono::steady_clock::now() - start); }
+};
+
+}  // namespace gmicpy
+
+#endif  // STATS_HPP
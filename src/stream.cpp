@@ -0,0 +1,267 @@
+#include "stream.hpp"
+
+#include "cow.hpp"
+#include "run_cache.hpp"
+#include "utils.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+using namespace cimg_library;
+
+/// Iterator over the results of a stream fed from another iterator
+class stream_py::iterator {
+    nb::object stream_obj;
+    stream_py &stream;
+    nb::object input;
+    bool exhausted = false;
+
+   public:
+    iterator(const nb::handle &stream, const nb::handle &frames)
+        : stream_obj(nb::borrow(stream)),
+          stream(nb::cast<stream_py &>(stream)),
+          input(nb::steal(PyObject_GetIter(frames.ptr())))
+    {
+        if (!input.is_valid())
+            nb::raise_python_error();
+    }
+
+    Img next()
+    {
+        // Keeps the stream full, so that frames are processed while the
+        // previous ones are consumed
+        while (!exhausted && stream.pending() < stream.depth) {
+            const auto frame = nb::steal(PyIter_Next(input.ptr()));
+            if (frame.is_valid())
+                stream.push(frame, false);
+            else if (PyErr_Occurred())
+                nb::raise_python_error();
+            else
+                exhausted = true;
+        }
+        if (stream.pending() == 0)
+            throw nb::stop_iteration();
+        return stream.pop();
+    }
+};
+
+/// Number of interpreters of a stream, 0 meaning the whole thread budget
+static unsigned int worker_count(const unsigned int threads)
+{
+    return threads ? threads : THREADS.get_total();
+}
+
+stream_py::stream_py(string cmd, const unsigned int threads,
+                     const unsigned int depth,
+                     const vector<shared_ptr<command_library>> &libraries,
+                     const bool cache)
+    : cmd(std::move(cmd)),
+      libraries(libraries),
+      cache(cache),
+      depth(depth ? depth : 2 * worker_count(threads)),
+      run_threads(max(THREADS.get_total() / worker_count(threads), 1U))
+{
+    workers.reserve(worker_count(threads));
+    while (workers.size() < worker_count(threads))
+        workers.emplace_back(&stream_py::work, this);
+}
+
+stream_py::~stream_py()
+{
+    nb::gil_scoped_release release;
+    {
+        lock_guard lock(mtx);
+        jobs.clear();
+    }
+    close();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void stream_py::work()
+{
+    // A worker whose interpreter fails to start answers its frames with
+    // the error, for pop() to raise it
+    optional<gmic> inter;
+    exception_ptr setup_error;
+    try {
+        inter.emplace();
+        for (const auto &lib : libraries)
+            inter->add_commands(lib->get_source().c_str(),
+                                lib->get_origin().c_str());
+    }
+    catch (...) {
+        setup_error = current_exception();
+    }
+
+    unique_lock lock(mtx);
+    while (true) {
+        has_job.wait(lock, [this] { return closed || !jobs.empty(); });
+        if (jobs.empty())
+            return;
+        auto [seq, frame] = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+
+        result res;
+        try {
+            if (setup_error)
+                rethrow_exception(setup_error);
+            CImgList<gmic_pixel_type> images;
+            CImgList<char> names;
+            frame.move_to(images);
+            {
+                const auto lease = THREADS.acquire(run_threads);
+                string key;
+                if (cache)
+                    key = run_cache::make_key(cmd, libraries, images, names,
+                                              lease.threads());
+                if (!cache || !RUN_CACHE.restore(key, images, names)) {
+                    {
+                        run_timer timer;
+                        inter->run(cmd.c_str(), images, names);
+                    }
+                    if (cache)
+                        RUN_CACHE.store(std::move(key), images, names);
+                }
+            }
+            if (images.size() != 1)
+                throw runtime_error(
+                    "Stream commands must output exactly one image per "
+                    "frame, got " +
+                    to_string(images.size()));
+            images[0].move_to(res.img);
+        }
+        catch (...) {
+            res.error = current_exception();
+        }
+
+        lock.lock();
+        results.emplace(seq, std::move(res));
+        has_result.notify_all();
+    }
+}
+
+size_t stream_py::pending()
+{
+    lock_guard lock(mtx);
+    return pushed - popped;
+}
+
+void stream_py::close()
+{
+    {
+        lock_guard lock(mtx);
+        closed = true;
+    }
+    has_job.notify_all();
+    has_room.notify_all();
+}
+
+void stream_py::push(const nb::handle &frame, const bool steal)
+{
+    Img img;
+    // Images with exported views are copied, as moving would leave the
+    // views dangling
+    if (nb::isinstance<Img>(frame) &&
+        (!steal || COW.is_pinned(nb::cast<const Img &>(frame)))) {
+        img.assign(nb::cast<const Img &>(frame));
+        STATS.copied(copy_path::IMAGE_COPY, owned_bytes(img));
+    }
+    else {
+        // Anything else goes through the Image constructor, whose result
+        // can be moved from
+        const auto obj = nb::isinstance<Img>(frame)
+                             ? nb::borrow(frame)
+                             : nb::type<Img>()(frame);
+        auto &src = nb::cast<Img &>(obj);
+        COW.detach(src);
+        STATS.image_resized(owned_bytes(src), 0);
+        src.move_to(img);
+    }
+
+    nb::gil_scoped_release release;
+    unique_lock lock(mtx);
+    has_room.wait(lock, [this] { return closed || pushed - popped < depth; });
+    if (closed)
+        throw runtime_error("Stream is closed");
+    jobs.emplace_back(pushed++, std::move(img));
+    has_job.notify_one();
+}
+
+stream_py::Img stream_py::pop()
+{
+    result res;
+    {
+        nb::gil_scoped_release release;
+        unique_lock lock(mtx);
+        if (popped == pushed)
+            throw out_of_range("No frame pending in the stream");
+        has_result.wait(lock, [this] { return results.contains(popped); });
+        res = std::move(results.extract(popped++).mapped());
+        has_room.notify_all();
+    }
+    if (res.error)
+        rethrow_exception(res.error);
+    return std::move(res.img);
+}
+
+void stream_py::bind(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic." << CLASSNAME << " class" << endl);
+    auto cls =
+        nb::class_<stream_py>(
+            m, CLASSNAME,
+            "Persistent pipeline applying a G'MIC command to a sequence of "
+            "frames. Frames are processed concurrently by threads warm "
+            "interpreters, and returned in order")
+            .def(nb::init<string, unsigned int, unsigned int,
+                          const vector<shared_ptr<command_library>> &,
+                          bool>(),
+                 "cmd"_a, "threads"_a = 1, "depth"_a = 0,
+                 "libraries"_a = vector<shared_ptr<command_library>>{},
+                 nb::kw_only(), "cache"_a = false,
+                 "threads is the number of interpreters (0 for the size of "
+                 "the thread budget), depth the maximum number of frames "
+                 "held by the stream (0 for twice the number of "
+                 "interpreters). The command must output one image per "
+                 "frame. If cache is set, frames are looked up in the cache "
+                 "of run outputs, as for Gmic.run(cache=True)")
+            .def("push", &stream_py::push, "frame"_a, nb::kw_only(),
+                 "steal"_a = false,
+                 "Queues a frame (an Image, or anything the Image "
+                 "constructor accepts). Images are copied unless steal is "
+                 "set, in which case they are moved and left empty (unless "
+                 "arrays or views were exported from them). Blocks "
+                 "while the stream holds depth frames")
+            .def("pop", &stream_py::pop,
+                 "Waits for the oldest pushed frame to be processed and "
+                 "returns it")
+            .def("close", &stream_py::close,
+                 "Stops the stream once the queued frames are processed. "
+                 "Pushing frames is no longer possible")
+            .def_prop_ro("pending", &stream_py::pending,
+                         "Number of frames pushed and not yet popped")
+            .def("__iter__", [](nb::object self) { return self; })
+            .def("__next__",
+                 [](stream_py &self) {
+                     if (self.pending() == 0)
+                         throw nb::stop_iteration();
+                     return self.pop();
+                 })
+            .def(
+                "process",
+                [](const nb::handle &self, const nb::handle &frames) {
+                    return new iterator(self, frames);
+                },
+                "frames"_a, nb::rv_policy::take_ownership,
+                "Returns an iterator over the processed frames of an "
+                "iterable, pushing frames ahead so that the stream stays "
+                "full");
+    nb::class_<iterator>(cls, "Iterator")
+        .def("__iter__", [](nb::object self) { return self; })
+        .def("__next__", &iterator::next);
+}
+
+}  // namespace gmicpy
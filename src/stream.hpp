@@ -0,0 +1,84 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <thread>
+
+#include "command_library.hpp"
+
+namespace gmicpy {
+
+/**
+ * Persistent pipeline applying one G'MIC command to a sequence of frames.
+ * Each worker thread owns an interpreter for the whole life of the stream,
+ * so that consecutive frames are processed concurrently by warm
+ * interpreters while the caller converts the next frames or consumes the
+ * previous ones. Results are handed out in push order.
+ */
+class stream_py {
+    using Img = cimg_library::CImg<gmic_pixel_type>;
+
+    struct result {
+        Img img{};
+        std::exception_ptr error{};
+    };
+
+    const std::string cmd;
+    const std::vector<std::shared_ptr<command_library>> libraries;
+    /// Whether outputs are looked up in and added to RUN_CACHE
+    const bool cache;
+    /// Maximum number of frames queued, processed or waiting to be popped
+    const size_t depth;
+    /// Threads leased by each worker's runs from the global budget
+    const unsigned int run_threads;
+
+    std::mutex mtx;
+    std::condition_variable has_job, has_result, has_room;
+    std::deque<std::pair<size_t, Img>> jobs;
+    std::map<size_t, result> results;
+    size_t pushed = 0, popped = 0;
+    bool closed = false;
+    std::vector<std::thread> workers;
+
+    void work();
+
+    /// Frames pushed but not popped yet
+    [[nodiscard]] size_t pending();
+
+    /// Ends the workers once the queued frames are processed
+    void close();
+
+    class iterator;
+
+   public:
+    constexpr static auto CLASSNAME = "Stream";
+
+    stream_py(std::string cmd, unsigned int threads, unsigned int depth,
+              const std::vector<std::shared_ptr<command_library>> &libraries,
+              bool cache);
+    stream_py(const stream_py &) = delete;
+    stream_py &operator=(const stream_py &) = delete;
+    ~stream_py();
+
+    /**
+     * Queues a frame: an Image (copied, or moved if steal is set and no
+     * views were exported from it) or anything the Image constructor
+     * accepts. Blocks while the stream
+     * holds depth frames.
+     */
+    void push(const nanobind::handle &frame, bool steal);
+
+    /**
+     * Waits for the oldest pushed frame to be processed and returns it, or
+     * raises the error its run, or its worker's interpreter setup, raised
+     */
+    Img pop();
+
+    static void bind(nanobind::module_ &m);
+};
+
+}  // namespace gmicpy
+
+#endif  // STREAM_HPP
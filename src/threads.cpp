@@ -0,0 +1,98 @@
+#include "threads.hpp"
+
+#include <thread>
+
+#include "gmicpy.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+
+thread_budget THREADS{};
+
+static unsigned int cpu_count()
+{
+    return max(thread::hardware_concurrency(), 1U);
+}
+
+static int omp_max_threads()
+{
+#if cimg_use_openmp != 0
+    return omp_get_max_threads();
+#else
+    return 0;
+#endif
+}
+
+thread_budget::lease::lease(thread_budget &budget, const unsigned int granted)
+    : budget(budget), granted(granted), previous(omp_max_threads())
+{
+#if cimg_use_openmp != 0
+    omp_set_num_threads(static_cast<int>(granted));
+#endif
+}
+
+thread_budget::lease::~lease()
+{
+#if cimg_use_openmp != 0
+    omp_set_num_threads(previous);
+#endif
+    lock_guard lock(budget.mtx);
+    budget.used -= granted;
+}
+
+thread_budget::thread_budget(const unsigned int total)
+    : total(total ? total : cpu_count())
+{
+}
+
+thread_budget::lease thread_budget::acquire(const unsigned int wanted)
+{
+    unsigned int granted;
+    {
+        lock_guard lock(mtx);
+        const auto available = used < total ? total - used : 0;
+        granted = max(min(wanted ? wanted : total, available), 1U);
+        used += granted;
+    }
+    LOG_DEBUG("Leased " << granted << " thread(s), wanted " << wanted
+                        << endl);
+    return {*this, granted};
+}
+
+void thread_budget::set_total(const unsigned int total)
+{
+    lock_guard lock(mtx);
+    this->total = total ? total : cpu_count();
+}
+
+unsigned int thread_budget::get_total() const
+{
+    lock_guard lock(mtx);
+    return total;
+}
+
+unsigned int thread_budget::get_used() const
+{
+    lock_guard lock(mtx);
+    return used;
+}
+
+void bind_threads(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic thread budget functions" << endl);
+    m.def(
+        "set_num_threads", [](const unsigned int n) { THREADS.set_total(n); },
+        "n"_a,
+        "Sets the process-wide number of threads shared by all concurrent "
+        "G'MIC runs (0 for the number of CPUs). Each run leases its threads "
+        "from this budget when it starts, up to its own 'threads' setting, "
+        "and always gets at least one");
+    m.def(
+        "get_num_threads", [] { return THREADS.get_total(); },
+        "Returns the process-wide number of threads shared by concurrent "
+        "G'MIC runs");
+}
+
+}  // namespace gmicpy
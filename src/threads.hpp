@@ -0,0 +1,52 @@
+#ifndef THREADS_HPP
+#define THREADS_HPP
+#include <mutex>
+
+namespace gmicpy {
+
+/**
+ * Process-wide budget of worker threads shared by concurrent G'MIC runs.
+ * Each run leases part of the budget for its duration and restricts the
+ * OpenMP team size of its calling thread accordingly, so that concurrent
+ * pipelines don't oversubscribe the machine.
+ */
+class thread_budget {
+    mutable std::mutex mtx;
+    unsigned int total;
+    unsigned int used = 0;
+
+   public:
+    /// Threads granted to a run, given back to the budget on destruction
+    class lease {
+        thread_budget &budget;
+        const unsigned int granted;
+        const int previous;
+
+       public:
+        lease(thread_budget &budget, unsigned int granted);
+        lease(const lease &) = delete;
+        lease &operator=(const lease &) = delete;
+        ~lease();
+
+        [[nodiscard]] unsigned int threads() const { return granted; }
+    };
+
+    /// @param total Number of threads in the budget, 0 for the CPU count
+    explicit thread_budget(unsigned int total = 0);
+
+    /**
+     * Leases up to wanted threads (the whole budget if 0). Never blocks: at
+     * least one thread is always granted, even if the budget is exhausted.
+     */
+    [[nodiscard]] lease acquire(unsigned int wanted);
+
+    void set_total(unsigned int total);
+    [[nodiscard]] unsigned int get_total() const;
+    [[nodiscard]] unsigned int get_used() const;
+};
+
+extern thread_budget THREADS;
+
+}  // namespace gmicpy
+
+#endif  // THREADS_HPP
@@ -294,6 +294,36 @@ nb::tuple to_tuple_func(I size, F get,
 
 #define ssnprintf(buf, ...) (snprintf(buf, std::size(buf), __VA_ARGS__), buf)
 
+/// Size of the pixel buffer owned by an image (shared images own nothing)
+template <class T>
+[[nodiscard]] size_t owned_bytes(const CImg<T> &img)
+{
+    return img.is_shared() ? 0 : img.size() * sizeof(T);
+}
+
+template <class T>
+[[nodiscard]] size_t owned_bytes(const CImgList<T> &list)
+{
+    size_t total = 0;
+    for (const auto &img : list)
+        total += owned_bytes(img);
+    return total;
+}
+
+/// Whether the buffers of two images share memory
+template <class T>
+[[nodiscard]] bool overlaps(const CImg<T> &a, const CImg<T> &b)
+{
+    return a.data() < b.data() + b.size() && b.data() < a.data() + a.size();
+}
+
+/// Formats a shape as a Python tuple
+[[nodiscard]] static string shape_to_string(const array<size_t, 4> &shape)
+{
+    return "(" + to_string(shape[0]) + ", " + to_string(shape[1]) + ", " +
+           to_string(shape[2]) + ", " + to_string(shape[3]) + ")";
+}
+
 [[nodiscard]] static string img_to_string(const CImg<> &img)
 {
     stringstream out;
@@ -0,0 +1,249 @@
+#include "volume.hpp"
+
+#include <fstream>
+
+#include "prefetcher.hpp"
+#include "utils.hpp"
+
+namespace gmicpy {
+namespace nb = nanobind;
+using namespace nanobind::literals;
+using namespace std;
+using namespace cimg_library;
+
+/// Iterator over consecutive slabs of a volume, read ahead in background
+class volume_py::slabs {
+    nb::object volume_obj;
+    unique_ptr<ordered_prefetcher<Img>> prefetcher;
+
+   public:
+    slabs(const nb::handle &volume, const unsigned int size,
+          const size_t read_ahead)
+        : volume_obj(nb::borrow(volume))
+    {
+        const auto &vol = nb::cast<const volume_py &>(volume);
+        prefetcher = make_unique<ordered_prefetcher<Img>>(
+            (vol.depth + size - 1) / size,
+            [&vol, size](const size_t i) {
+                const auto z0 = static_cast<unsigned int>(i) * size;
+                return vol.load(z0, min(z0 + size, vol.depth));
+            },
+            read_ahead, 1);
+    }
+
+    ~slabs()
+    {
+        // Waits for in-flight reads, which don't need the GIL
+        nb::gil_scoped_release release;
+        prefetcher.reset();
+    }
+
+    Img next()
+    {
+        optional<Img> slab;
+        {
+            nb::gil_scoped_release release;
+            slab = prefetcher->next();
+        }
+        if (!slab)
+            throw nb::stop_iteration();
+        return std::move(*slab);
+    }
+
+    [[nodiscard]] size_t size() const { return prefetcher->size(); }
+};
+
+volume_py::volume_py(filesystem::path path) : path(std::move(path))
+{
+    nb::gil_scoped_release release;
+    if (!open_tiff() && !open_cimg()) {
+        kind = storage::WHOLE;
+        whole.load(this->path.string().c_str());
+        width = whole.width();
+        height = whole.height();
+        depth = whole.depth();
+        spectrum = whole.spectrum();
+    }
+    LOG_DEBUG("Opened " << this->path << " (" << width << ", " << height
+                        << ", " << depth << ", " << spectrum << ')' << endl);
+}
+
+static string lowercase(string str)
+{
+    ranges::transform(str, str.begin(), [](const unsigned char c) {
+        return static_cast<char>(tolower(c));
+    });
+    return str;
+}
+
+bool volume_py::open_tiff()
+{
+    const auto ext = lowercase(path.extension().string());
+    if (ext != ".tif" && ext != ".tiff")
+        return false;
+#ifdef cimg_use_tiff
+    TIFF *tif = TIFFOpen(path.string().c_str(), "r");
+    if (!tif)
+        return false;
+    unsigned int pages = 0;
+    do {
+        ++pages;
+    } while (TIFFReadDirectory(tif));
+    TIFFClose(tif);
+
+    // Pages are stacked along z: the first one gives the other dimensions
+    Img first;
+    first.load_tiff(path.string().c_str(), 0, 0);
+    if (first.depth() != 1)
+        return false;
+    kind = storage::TIFF;
+    width = first.width();
+    height = first.height();
+    depth = pages;
+    spectrum = first.spectrum();
+    return true;
+#else
+    // Counting pages needs libtiff
+    return false;
+#endif
+}
+
+/// Pixel types CImg writes in .cimg headers
+static constexpr string_view CIMG_PIXEL_TYPES[] = {
+    "bool",   "char",  "unsigned_char", "uchar", "short", "unsigned_short",
+    "ushort", "int",   "unsigned_int",  "uint",  "int64", "unsigned_int64",
+    "uint64", "long",  "unsigned_long", "ulong", "float", "double"};
+
+bool volume_py::open_cimg()
+{
+    if (lowercase(path.extension().string()) != ".cimg")
+        return false;
+    ifstream in(path, ios::binary);
+    string header, dims;
+    if (!getline(in, header) || !getline(in, dims))
+        return false;
+    // "<count> <pixel type> [<endianness>]", then
+    // "<w> <h> <d> <c>[ #<size>]" for each image. Compressed images can't
+    // be read partially.
+    unsigned int count = 0;
+    string type, endianness;
+    istringstream(header) >> count >> type >> endianness;
+    type = lowercase(type);
+    endianness = lowercase(endianness);
+    if (count == 0 || ranges::find(CIMG_PIXEL_TYPES, type) ==
+                          end(CIMG_PIXEL_TYPES))
+        return false;
+    if (!endianness.empty() && endianness != "little_endian" &&
+        endianness != "big_endian")
+        return false;
+    if (count > 1)
+        throw nb::value_error(
+            (path.string() + " holds " + to_string(count) +
+             " images, volumes can only be read from single images")
+                .c_str());
+    if (dims.find('#') != string::npos)
+        return false;
+    istringstream dims_in(dims);
+    if (!(dims_in >> width >> height >> depth >> spectrum))
+        return false;
+    kind = storage::CIMG;
+    return true;
+}
+
+volume_py::Img volume_py::load(const unsigned int z0,
+                               const unsigned int z1) const
+{
+    Img img;
+    if (z1 <= z0)
+        return img;
+    switch (kind) {
+        case storage::TIFF:
+            img.load_tiff(path.string().c_str(), z0, z1 - 1);
+            break;
+        case storage::CIMG:
+            img.load_cimg(path.string().c_str(), 0, 0, 0, 0, z0, 0,
+                          width - 1, height - 1, z1 - 1, spectrum - 1);
+            break;
+        case storage::WHOLE:
+            img = whole.get_slices(z0, z1 - 1);
+            break;
+    }
+    return img;
+}
+
+void volume_py::bind(nb::module_ &m)
+{
+    LOG_DEBUG("Binding gmic." << CLASSNAME << " class" << endl);
+    const auto range = [](const volume_py &vol, const long start,
+                          const optional<long> stop) {
+        const auto clamp = [&](long z) {
+            if (z < 0)
+                z += vol.depth;
+            return static_cast<unsigned int>(
+                std::clamp(z, 0L, static_cast<long>(vol.depth)));
+        };
+        const auto z0 = clamp(start);
+        return pair(z0, stop ? clamp(*stop) : min(z0 + 1, vol.depth));
+    };
+
+    auto cls =
+        nb::class_<volume_py>(
+            m, CLASSNAME,
+            "Volume stored in a file, whose slices (or TIFF pages) are "
+            "loaded on demand. Uncompressed .cimg files, and multi-page "
+            "TIFF files if libtiff is available, are read partially; other "
+            "files are loaded whole when opened. .cimg files holding "
+            "several images raise a ValueError")
+            .def(nb::init<filesystem::path>(), "path"_a)
+            .def_prop_ro(
+                "shape",
+                [](const volume_py &vol) {
+                    return nb::make_tuple(vol.width, vol.height, vol.depth,
+                                          vol.spectrum);
+                },
+                "Shape of the whole volume, in xyzc order")
+            .def_prop_ro("path",
+                         [](const volume_py &vol) { return vol.path; })
+            .def("__len__", [](const volume_py &vol) { return vol.depth; })
+            .def(
+                "load",
+                [range](const volume_py &vol, const long start,
+                        const optional<long> stop) {
+                    const auto [z0, z1] = range(vol, start, stop);
+                    nb::gil_scoped_release release;
+                    return vol.load(z0, z1);
+                },
+                "start"_a, "stop"_a = nb::none(),
+                "Loads slices start to stop (excluded, defaults to "
+                "start + 1) as an image. Negative values are relative to "
+                "the end of the volume")
+            .def(
+                "slabs",
+                [](const nb::handle &self, const unsigned int size,
+                   const size_t read_ahead) {
+                    if (size == 0)
+                        throw nb::value_error("Slab size must be positive");
+                    return new slabs(self, size, read_ahead);
+                },
+                "size"_a, nb::kw_only(), "read_ahead"_a = 1,
+                nb::rv_policy::take_ownership,
+                "Returns an iterator over consecutive slabs of size slices "
+                "(the last one may be thinner). Up to read_ahead slabs are "
+                "loaded in the background while the previous ones are "
+                "processed");
+    nb::class_<slabs>(cls, "Slabs")
+        .def("__iter__", [](nb::object self) { return self; })
+        .def("__next__", &slabs::next)
+        .def("__len__", &slabs::size);
+
+    m.def(
+        "open_volume",
+        [](const filesystem::path &path) { return new volume_py(path); },
+        "path"_a, nb::rv_policy::take_ownership,
+        "Opens a volume file (e.g. a .cimg file or a multi-page TIFF) "
+        "whose slices can then be loaded on demand, see gmic.Volume");
+}
+
+void bind_volume(nb::module_ &m) { volume_py::bind(m); }
+
+}  // namespace gmicpy
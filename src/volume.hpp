@@ -0,0 +1,42 @@
+#ifndef VOLUME_HPP
+#define VOLUME_HPP
+#include "gmicpy.hpp"
+
+namespace gmicpy {
+
+/**
+ * Volume stored in a file, whose z-slices (or TIFF pages) are loaded on
+ * demand instead of all at once. Uncompressed .cimg files and multi-page
+ * TIFF files (with libtiff) are read partially; other files are loaded
+ * whole when opened.
+ */
+class volume_py {
+    using Img = cimg_library::CImg<gmic_pixel_type>;
+
+    enum class storage : uint8_t { TIFF, CIMG, WHOLE };
+
+    std::filesystem::path path;
+    storage kind = storage::WHOLE;
+    unsigned int width = 0, height = 0, depth = 0, spectrum = 0;
+    /// Fully loaded image, for files that can't be read partially
+    Img whole{};
+
+    bool open_tiff();
+    bool open_cimg();
+
+    class slabs;
+
+   public:
+    constexpr static auto CLASSNAME = "Volume";
+
+    explicit volume_py(std::filesystem::path path);
+
+    /// Loads slices [z0, z1), without the GIL. Thread-safe.
+    [[nodiscard]] Img load(unsigned int z0, unsigned int z1) const;
+
+    static void bind(nanobind::module_ &m);
+};
+
+}  // namespace gmicpy
+
+#endif  // VOLUME_HPP
@@ -0,0 +1,106 @@
+import io
+from pathlib import Path
+
+import PIL.Image
+import gmic
+import numpy as np
+import pytest
+from numpy.testing import assert_array_equal
+
+TEST_IMAGE = 'images/link_13x16_rgba.png'
+
+
+@pytest.fixture
+def img_path(request) -> Path:
+    return Path(request.fspath.dirname) / TEST_IMAGE
+
+
+def test_from_bytes(img_path):
+    data = img_path.read_bytes()
+    expected = gmic.Image(img_path)
+    assert gmic.Image.from_bytes(data) == expected
+    assert gmic.Image.from_bytes(bytearray(data), "png") == expected
+    assert gmic.Image.from_bytes(memoryview(data), format=".PNG") == expected
+
+    lst = gmic.ImageList.from_bytes(data)
+    assert len(lst) == 1 and lst[0] == expected
+
+    with pytest.raises(ValueError):
+        gmic.Image.from_bytes(b"not an image")
+    with pytest.raises(ValueError):
+        gmic.Image.from_bytes(data, "webm")
+
+
+def test_from_bytes_tiff(img_path):
+    frames = [PIL.Image.open(img_path).convert("RGB")] * 3
+    buf = io.BytesIO()
+    frames[0].save(buf, "TIFF", save_all=True, append_images=frames[1:])
+
+    lst = gmic.ImageList.from_bytes(buf.getvalue())
+    assert len(lst) == 3
+    assert_array_equal(lst[2].yxc, frames[2])
+
+    # Decoded as a single image, frames are stacked along z
+    img = gmic.Image.from_bytes(buf.getvalue(), "tif")
+    assert img.shape == (13, 16, 3, 3)
+
+
+def test_encode(img_path):
+    img = gmic.Image(img_path)
+    data = img.encode("png")
+    assert data.startswith(b"\x89PNG")
+    assert gmic.Image.from_bytes(data) == img
+    assert gmic.Image.from_bytes(img.encode("cimgz")) == img
+    assert img.encode("jpeg", quality=80).startswith(b"\xff\xd8\xff")
+
+    with pytest.raises(TypeError):
+        img.encode("png", quality=80)
+
+
+def test_encode_pfm():
+    img = gmic.Image(np.random.rand(5, 4, 1, 3).astype(np.float32))
+    data = img.encode("pfm")
+    assert data.startswith(b"PF\n5 4\n")
+    assert gmic.Image.from_bytes(data) == img
+
+
+def test_encode_list(img_path):
+    lst = gmic.ImageList([gmic.Image(img_path)] * 3)
+    decoded = gmic.ImageList.from_bytes(lst.encode("tiff", compression="lzw"))
+    assert len(decoded) == 3
+    assert decoded[1] == lst[1]
+    assert len(gmic.ImageList.from_bytes(lst.encode("cimg"))) == 3
+
+    with pytest.raises(ValueError):
+        lst.encode("png")
+
+
+def test_many(img_path):
+    img = gmic.Image(img_path)
+    encoded = gmic.encode_many([img, -img, img], "png", threads=2)
+    assert len(encoded) == 3 and encoded[0] == encoded[2]
+
+    decoded = gmic.decode_many(encoded + [img_path], threads=2)
+    assert len(decoded) == 4
+    assert decoded[0] == img and decoded[3] == img
+    assert gmic.encode_many(decoded, "cimgz")[0] == img.encode("cimgz")
+
+    with pytest.raises(ValueError):
+        gmic.decode_many([encoded[0], b"garbage"])
+
+
+def test_open_volume(tmp_path):
+    data = np.broadcast_to(np.arange(20, dtype=np.float32)[None, None, :, None], (5, 4, 20, 2))
+    path = tmp_path / "volume.cimg"
+    path.write_bytes(gmic.Image(np.ascontiguousarray(data)).encode("cimg"))
+
+    vol = gmic.open_volume(path)
+    assert vol.shape == (5, 4, 20, 2) and len(vol) == 20
+    slab = vol.load(3, 7)
+    assert slab.shape == (5, 4, 4, 2)
+    assert slab[0, 0, 0, 0] == 3 and slab[4, 3, 3, 1] == 6
+    assert vol.load(-1)[0, 0, 0, 0] == 19
+
+    slabs = vol.slabs(8, read_ahead=2)
+    assert len(slabs) == 3
+    assert [s.depth for s in slabs] == [8, 8, 4]
@@ -1,8 +1,12 @@
+from pathlib import Path
+
 import gmic
 import numpy as np
 import numpy.testing as nptest
 import pytest
 
+from conftest import gmic_instance_types
+
 
 @pytest.fixture
 def npdata():
@@ -25,3 +29,178 @@ def test_construct(img):
     lst = gmic.ImageList([img])
     assert len(lst) == 1
     nptest.assert_array_equal(img, lst[0])
+
+
+def test_mutable_sequence(img):
+    from collections.abc import MutableSequence
+
+    lst = gmic.ImageList([img])
+    assert isinstance(lst, MutableSequence)
+    lst.append(img)
+    lst.insert(0, gmic.Image(np.zeros((2, 2, 1, 1), dtype=np.float32)))
+    assert len(lst) == 3
+    assert lst[-1] == img and lst[0] != img
+    assert lst.index(img) == 1 and lst.count(img) == 2 and img in lst
+
+    head = lst[:2]
+    assert len(head) == 2 and head[1] == img
+    del lst[::2]
+    assert len(lst) == 1
+    lst[:] = [img, img, img]
+    assert len(lst) == 3
+    lst += [img]
+    assert len(lst) == 4
+
+    popped = lst.pop()
+    assert popped == img and len(lst) == 3
+    lst.remove(img)
+    assert len(lst) == 2
+    lst.clear()
+    assert len(lst) == 0
+
+    with pytest.raises(IndexError):
+        lst.pop()
+
+
+def test_item_references(img):
+    lst = gmic.ImageList([img, gmic.Image(np.zeros((2, 2, 1, 1), dtype=np.float32))])
+    first, second = lst[0], lst[1]
+    assert lst[0] is first
+
+    # Modifying items modifies the list
+    lst[0] += 1
+    assert lst[0] is first and first != img
+    first.fill(7)
+    assert lst[0].at(0, 0, 0) == (7,)
+    first.as_numpy()[0, 0, 0, 0] = 3
+    assert lst[0].at(0, 0, 0) == (3,)
+    second.assign_dims(3, 3, 1, 1)
+    assert lst[1].shape == (3, 3, 1, 1)
+
+    # Items keep referring to the same image whatever happens to the list
+    lst.insert(0, gmic.Image(1, 1, 1, 1))
+    lst.reverse()
+    assert lst[2] is first and lst[0] is second
+    assert lst.pop(0) is second
+    del lst[1]
+    lst.clear()
+    assert first.at(0, 0, 0) == (3,) and second.shape == (3, 3, 1, 1)
+
+    # Items of shared batches stay valid once the list is gone
+    batch = np.ones((2, 3, 4, 1), dtype=np.float32)
+    item = gmic.ImageList.from_batch(batch)[1]
+    batch[1] = 2
+    assert item.at(0, 0, 0) == (1,)
+
+
+def test_steal(img):
+    copy = +img
+    lst = gmic.ImageList()
+    lst.append(img, steal=True)
+    assert len(lst) == 1 and lst[0] == copy
+    assert img.size == 0
+
+    lst.extend([copy], steal=True)
+    assert copy.size == 0 and len(lst) == 2
+
+    # Images arrays were exported from are copied, leaving the arrays valid
+    pinned = +img
+    view = pinned.as_numpy()
+    lst.append(pinned, steal=True)
+    assert pinned.size == view.size and lst[-1] == pinned
+    view[0, 0, 0, 0] += 1
+    assert lst[-1] != pinned
+
+
+def test_string_list():
+    names = gmic.StringList(["a", "b"])
+    names.append("c")
+    names.reverse()
+    assert list(names) == ["c", "b", "a"]
+    assert names.pop(0) == "c" and "a" in names
+
+
+@pytest.mark.parametrize("step", [2, -2, 3, -3, -1])
+def test_del_extended_slice(step):
+    values = list("abcdefg")
+    names = gmic.StringList(values)
+    del names[::step]
+    del values[::step]
+    assert list(names) == values
+
+
+def test_batch():
+    batch = np.arange(2 * 3 * 1 * 4 * 5, dtype=np.float32).reshape(2, 3, 1, 4, 5)
+    lst = gmic.ImageList.from_batch(batch)
+    assert len(lst) == 2
+    assert lst[1].shape == (5, 4, 1, 3)
+    assert lst[1][2, 3, 0, 1] == batch[1, 1, 0, 3, 2]
+    batch[1, 1, 0, 3, 2] = -1
+    assert lst[1][2, 3, 0, 1] == -1
+    nptest.assert_array_equal(lst.to_batch(), batch)
+
+    copied = gmic.ImageList.from_batch(batch, shared=False)
+    batch[0] = 0
+    assert copied[0][0, 0, 0, 0] != 0 or copied[0][1, 0, 0, 0] != 0
+
+    hwc = np.arange(2 * 4 * 5 * 3, dtype=np.float32).reshape(2, 4, 5, 3)
+    lst = gmic.ImageList.from_batch(hwc)
+    assert lst[1].shape == (5, 4, 1, 3)
+    assert lst[1][2, 3, 1] == hwc[1, 3, 2, 1]
+    nptest.assert_array_equal(lst.to_batch("nyxc"), hwc)
+
+    gray = np.arange(2 * 4 * 5, dtype=np.float32).reshape(2, 4, 5)
+    lst = gmic.ImageList.from_batch(gray)
+    assert lst[1].shape == (5, 4, 1, 1)
+    assert lst[1][2, 3] == gray[1, 3, 2]
+    nptest.assert_array_equal(lst.to_batch("nyx"), gray)
+    assert gmic.ImageList.from_batch(gray[:, 0])[1].shape == (5, 1, 1, 1)
+
+    with pytest.raises(ValueError):
+        gmic.ImageList([gmic.Image(1, 1, 1, 1), gmic.Image(2, 2, 1, 1)]).to_batch()
+
+
+def test_stats():
+    data = [np.arange(24, dtype=np.float32).reshape(2, 3, 4, 1), np.ones((5, 5, 1, 3), dtype=np.float32)]
+    stats = gmic.ImageList([gmic.Image(d) for d in data]).stats()
+    assert [s["max"] for s in stats] == [23, 1]
+    assert stats[0]["mean"] == pytest.approx(11.5)
+    per_channel = gmic.ImageList([gmic.Image(d) for d in data]).stats(axis="xyz")
+    assert per_channel[1]["sum"].shape == (1, 1, 1, 3)
+    nptest.assert_array_equal(per_channel[1]["sum"].ravel(), [25, 25, 25])
+
+
+def test_digest(img):
+    lst = gmic.ImageList([img, gmic.Image(1, 2, 1, 1)])
+    assert lst.digest() == gmic.ImageList([+img, gmic.Image(1, 2, 1, 1)]).digest()
+    assert lst.digest() != gmic.ImageList([img]).digest()
+    assert lst.digest() != gmic.ImageList([gmic.Image(1, 2, 1, 1), img]).digest()
+
+
+def test_string_list_bulk():
+    names = gmic.StringList.from_list(["a", "", "héllo"])
+    assert len(names) == 3
+    assert names.to_list() == ["a", "", "héllo"]
+
+
+@pytest.mark.parametrize(**gmic_instance_types)
+def test_run_return_names(gmic_instance_run):
+    images, names = gmic_instance_run("1,1 name foo", return_names=True)
+    assert len(images) == 1
+    assert names.to_list() == ["foo"]
+    assert len(gmic_instance_run("1,1 name foo")) == 1
+
+
+def test_from_files(request):
+    path = Path(request.fspath.dirname) / "images/link_13x16_rgba.png"
+    files = gmic.ImageList.from_files([path] * 5, prefetch=2, threads=2)
+    assert len(files) == 5
+    images = list(files)
+    assert len(images) == 5
+    assert all(img.shape == (13, 16, 1, 4) for img in images)
+    assert images[0] == images[4]
+
+    files = gmic.ImageList.from_files([path, path.with_name("missing.png")])
+    assert next(files).shape == (13, 16, 1, 4)
+    with pytest.raises(Exception):
+        next(files)
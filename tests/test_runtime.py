@@ -0,0 +1,321 @@
+import os
+import subprocess
+import sys
+import sysconfig
+import threading
+from concurrent.futures import ThreadPoolExecutor
+
+import gmic
+import numpy as np
+import pytest
+
+
+def test_stats():
+    gmic.reset_stats()
+    stats = gmic.stats()
+    assert stats["runs"] == 0
+    assert set(stats["bytes_copied"]) >= {"ndarray_to_image", "image_to_ndarray", "yxc_to_image", "image_to_yxc",
+                                          "image_copy", "list_item"}
+
+    nbytes = 4 * 5 * 1 * 3 * 4
+    img = gmic.Image(np.zeros((4, 5, 1, 3), dtype=np.float32))
+    img.to_numpy()
+    lst = gmic.run("blur 1", gmic.ImageList([img]))
+    assert len(lst) == 1
+
+    stats = gmic.stats()
+    assert stats["runs"] == 1
+    assert stats["run_time"] > 0
+    assert sum(count for _, count in stats["run_time_histogram"]) == 1
+    assert stats["bytes_copied"]["ndarray_to_image"] == nbytes
+    assert stats["bytes_copied"]["image_to_ndarray"] == nbytes
+    assert stats["bytes_copied"]["list_item"] == nbytes
+    assert stats["images_allocated"] >= 2
+
+    live = stats["live_image_bytes"]
+    del img, lst
+    stats = gmic.stats()
+    assert stats["live_image_bytes"] == live - 2 * nbytes
+    assert stats["images_freed"] >= 2
+
+    gmic.reset_stats()
+    assert gmic.stats()["runs"] == 0
+
+
+def test_threads():
+    default = gmic.get_num_threads()
+    assert default >= 1
+    try:
+        gmic.set_num_threads(2)
+        assert gmic.get_num_threads() == 2
+
+        inter = gmic.Gmic(threads=1)
+        assert inter.threads == 1
+        lst = inter.run("1,1 +blur 1")
+        assert len(lst) == 2
+        lst = inter.run("blur 1", lst, threads=4)
+        assert len(lst) == 2
+        assert len(gmic.run("1,1", threads=1)) == 1
+
+        gmic.set_num_threads(0)
+        assert gmic.get_num_threads() >= 1
+    finally:
+        gmic.set_num_threads(default)
+
+
+def test_command_library(tmp_path):
+    source = ("#@cli foo : value\n"
+              "foo :\n"
+              "  fill $1\n"
+              "\n"
+              "bar : skip ${1=2}\n"
+              "  foo $1\n")
+    lib = gmic.CommandLibrary.load(source)
+    assert lib.names == ["foo", "bar"]
+    assert "foo" in lib and "baz" not in lib
+    assert lib["bar"].startswith("bar :")
+    assert gmic.CommandLibrary.load(source) is lib
+
+    path = tmp_path / "lib.gmic"
+    path.write_text(source)
+    libf = gmic.CommandLibrary.load(path)
+    assert libf.version == lib.version
+    assert gmic.CommandLibrary.load(str(path)) is libf
+
+    inter = gmic.Gmic(libraries=[lib])
+    inter.attach(lib)
+    assert len(inter.libraries) == 1
+    lst = inter.run("1,1 bar 3")
+    assert lst[0][0, 0] == 3
+    assert gmic.Gmic(libraries=[libf]).run("1,1 foo 5")[0][0, 0] == 5
+
+
+def test_stream():
+    frames = [gmic.Image(np.full((4, 3, 1, 1), i, dtype=np.float32)) for i in range(6)]
+    stream = gmic.Stream("+ 1", threads=2, depth=3)
+    results = list(stream.process(frames))
+    assert [img[0, 0] for img in results] == [i + 1 for i in range(6)]
+    assert frames[2][0, 0] == 2
+
+    stream.push(frames[0])
+    stream.push(np.zeros((2, 2, 1, 1), dtype=np.float32))
+    assert stream.pending == 2
+    assert stream.pop()[0, 0] == 1
+    assert stream.pop().shape == (2, 2, 1, 1)
+    with pytest.raises(IndexError):
+        stream.pop()
+
+    stream.close()
+    with pytest.raises(RuntimeError):
+        stream.push(frames[0])
+
+    bad = gmic.Stream("+ 1 +blur 1")
+    bad.push(frames[0])
+    with pytest.raises(RuntimeError):
+        bad.pop()
+
+
+def test_run_cache():
+    gmic.clear_run_cache()
+    gmic.reset_stats()
+    img = gmic.Image(np.arange(24, dtype=np.float32).reshape(4, 3, 2, 1))
+    first = gmic.run("blur 1 * 2", gmic.ImageList([img]), cache=True)
+    second = gmic.run("blur 1 * 2", gmic.ImageList([+img]), cache=True)
+    assert second[0] == first[0]
+    stats = gmic.stats()
+    assert stats["runs"] == 1
+    assert stats["run_cache"]["hits"] == 1 and stats["run_cache"]["misses"] == 1
+    # Images and their names are held
+    entry = stats["run_cache"]["bytes"]
+    assert entry >= 24 * 4
+
+    # Other inputs, commands and uncached runs go through G'MIC
+    gmic.run("blur 1 * 2", gmic.ImageList([img + 1]), cache=True)
+    gmic.run("blur 2 * 2", gmic.ImageList([img]), cache=True)
+    gmic.run("blur 1 * 2", gmic.ImageList([img]))
+    assert gmic.stats()["runs"] == 4
+
+    # Least recently used outputs are evicted past the capacity
+    size = gmic.get_run_cache_size()
+    try:
+        gmic.set_run_cache_size(2 * entry)
+        assert gmic.stats()["run_cache"]["evicted_bytes"] == entry
+        gmic.set_run_cache_size(0)
+        gmic.run("blur 1 * 2", gmic.ImageList([img]), cache=True)
+        assert gmic.stats()["run_cache"]["bytes"] == 0
+    finally:
+        gmic.set_run_cache_size(size)
+
+    hits = gmic.stats()["run_cache"]["hits"]
+    frames = [gmic.Image(np.full((4, 3, 1, 1), i % 2, dtype=np.float32)) for i in range(4)]
+    results = list(gmic.Stream("+ 1", cache=True).process(frames))
+    assert [img[0, 0] for img in results] == [1, 2, 1, 2]
+    assert gmic.stats()["run_cache"]["hits"] == hits + 2
+
+
+def test_copy_on_write():
+    assert not gmic.get_copy_on_write()
+    gmic.set_copy_on_write(True)
+    try:
+        img = gmic.Image(np.zeros((4, 3, 2, 1), dtype=np.float32))
+        gmic.reset_stats()
+        live = gmic.stats()["live_image_bytes"]
+        size = sys.getsizeof(img)
+        copy = +img
+        other = gmic.Image()
+        other.assign_copy(img)
+        lst = gmic.ImageList([img])
+        lst[0] = copy
+        assert gmic.stats()["bytes_copied"]["image_copy"] == 0
+        assert gmic.stats()["bytes_copied"]["list_item"] == 0
+        assert gmic.stats()["live_image_bytes"] == live
+        assert copy == img and other == img and lst[0] == img
+        # Copying turns the source into one of the users of its buffer, which
+        # is still accounted to it
+        assert sys.getsizeof(img) == sys.getsizeof(copy) == size
+
+        # Replaced copies drop the shared buffer instead of copying it
+        replaced = +img
+        replaced.assign_dims(2, 2, 1, 1)
+        assert gmic.stats()["bytes_copied"]["image_copy"] == 0
+        assert replaced.shape == (2, 2, 1, 1) and img.at(1, 0, 0) == (0,)
+        del replaced
+
+        # Modified copies get a buffer of their own, others keep sharing
+        copy += 1
+        other.fill("3")
+        assert gmic.stats()["bytes_copied"]["image_copy"] == 2 * 24 * 4
+        assert img.at(1, 0, 0) == (0,) and copy.at(1, 0, 0) == (1,)
+        assert other.at(1, 0, 0) == (3,)
+        assert sys.getsizeof(img) == sys.getsizeof(copy) == size
+        img.as_numpy()[1, 0, 0, 0] = 5
+        assert lst[0].at(1, 0, 0) == (0,)
+        gmic.run("+ 1", lst)
+        assert lst[0].at(1, 0, 0) == (1,) and img.at(1, 0, 0) == (5,)
+
+        # Images with exported views are copied right away
+        view = img.as_numpy()
+        copied = +img
+        view[0, 0, 0, 0] = 7
+        assert copied.at(0, 0, 0) == (0,)
+
+        del copy, other, lst, view, copied
+        assert gmic.stats()["live_image_bytes"] == live
+    finally:
+        gmic.set_copy_on_write(False)
+
+
+def test_kernel_variants():
+    flags = gmic.__build_flags__
+    variants = flags["GMICPY_ISA_VARIANTS"].split(",")
+    assert variants[0] == "baseline"
+    assert flags["GMICPY_ISA"] in variants
+    # The module imported is one of the per-ISA builds of the whole extension
+    assert flags["GMICPY_MODULE"] == "gmic._core_" + flags["GMICPY_ISA"]
+    assert flags["GMICPY_MODULE"] in sys.modules
+    assert gmic.Image.__module__ == "gmic"
+
+    code = ("import gmic, numpy as np; print(gmic.__build_flags__['GMICPY_MODULE'].rpartition('_')[2]); "
+            "img = gmic.Image(np.linspace(0, 1, 100003, dtype=np.float32).reshape(-1, 1, 1, 1)); "
+            "print((img * 1.5).digest().hex()); "
+            "print(b''.join(np.asarray(v).tobytes() for v in img.stats().values()).hex())")
+
+    def run(isa):
+        env = dict(os.environ, GMICPY_ISA=isa)
+        return subprocess.run([sys.executable, "-c", code], env=env, capture_output=True, text=True, check=True)
+
+    # The baseline variant can always be forced, and computes the same values
+    forced, default = run("baseline"), run("")
+    assert forced.stdout.split()[0] == "baseline"
+    assert default.stdout.split()[0] == flags["GMICPY_ISA"]
+    assert forced.stdout.split()[1:] == default.stdout.split()[1:]
+    unknown = run("sse1")
+    assert "RuntimeWarning" in unknown.stderr
+    assert unknown.stdout.split()[0] == flags["GMICPY_ISA"]
+
+
+def test_free_threading():
+    if sysconfig.get_config_var("Py_GIL_DISABLED"):
+        # Importing gmic mustn't have re-enabled the GIL
+        assert not sys._is_gil_enabled()
+
+    shared = gmic.ImageList()
+    source = gmic.Image(np.arange(24, dtype=np.float32).reshape((4, 3, 2, 1)))
+    wrapper = source.yxc
+    expected = wrapper.tobytes()
+    inter = gmic.Gmic()
+
+    def work(i):
+        for _ in range(20):
+            lst = inter.run("+ 1", gmic.ImageList([source]))
+            assert lst[0].at(0, 0, 0) == (1,)
+            assert lst.stats()[0]["max"] == 24
+            shared.append(+source)
+            assert wrapper.tobytes() == expected
+            assert np.array_equal(np.asarray(wrapper), wrapper.to_numpy())
+            # Items stay valid while other threads append
+            assert shared[-1] == source
+        return i
+
+    with ThreadPoolExecutor(8) as pool:
+        assert sorted(pool.map(work, range(8))) == list(range(8))
+    assert len(shared) == 8 * 20
+
+
+def test_memory_limit():
+    info = gmic.memory_info()
+    assert info["limit"] is None and not info["blocking"]
+    assert info["runs"] == 0 and gmic.Gmic().run_bytes == 0
+    assert issubclass(gmic.MemoryLimitError, MemoryError)
+
+    img = gmic.Image(np.zeros((4, 3, 2, 1), dtype=np.float32))
+    assert sys.getsizeof(img) >= 24 * 4
+    assert sys.getsizeof(gmic.ImageList([img, img])) >= 2 * 24 * 4
+
+    def zeros(n):
+        return np.zeros((n, 1, 1, 1), dtype=np.float32)
+
+    try:
+        gmic.set_memory_limit(gmic.memory_info()["images"] + 1000)
+        assert gmic.memory_info()["limit"] is not None
+        small = gmic.Image(zeros(100))
+        with pytest.raises(gmic.MemoryLimitError):
+            gmic.Image(zeros(1000))
+        # Checked before allocating, and failures don't keep their room
+        with pytest.raises(gmic.MemoryLimitError):
+            gmic.Image(1 << 20, 1 << 20, 1, 1)
+        for _ in range(3):
+            with pytest.raises(gmic.MemoryLimitError):
+                gmic.Image(200, 1, 1, 1)
+        copy = +small
+        with pytest.raises(MemoryError):
+            +small
+        # Results of operators are checked before allocating them
+        with pytest.raises(gmic.MemoryLimitError):
+            small + 1
+        # Decoded images are checked from the dimensions in their header,
+        # before decoding their data
+        huge = b"P5\n65536 65536\n255\n"
+        with pytest.raises(gmic.MemoryLimitError):
+            gmic.Image.from_bytes(huge)
+        with pytest.raises(gmic.MemoryLimitError):
+            gmic.ImageList.from_bytes(huge)
+        del small, copy
+
+        # Blocking allocations wait for other threads to free images
+        gmic.set_memory_limit(gmic.memory_info()["images"] + 1000, block=True, timeout=10)
+        held = [gmic.Image(zeros(200))]
+        timer = threading.Timer(0.1, held.clear)
+        timer.start()
+        waited = gmic.Image(zeros(200))
+        timer.join()
+        assert not held and waited.size == 200
+
+        gmic.set_memory_limit(gmic.memory_info()["images"], block=True, timeout=0.05)
+        with pytest.raises(gmic.MemoryLimitError):
+            gmic.Image(zeros(10))
+        with pytest.raises(gmic.MemoryLimitError):
+            gmic.run("1,1", gmic.ImageList([waited]))
+    finally:
+        gmic.set_memory_limit(0)
+    assert gmic.memory_info()["limit"] is None